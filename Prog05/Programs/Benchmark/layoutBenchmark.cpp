@@ -0,0 +1,122 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+
+#include "../Version4/elevationMap.h"
+#include "../Version4/descentIndex.h"
+
+// Map layout benchmark.
+//
+// Compares the row-major and the tiled (64x64 tiles in Morton order) layouts
+// of the Version 4 maps: for each map, times the descents of a set of random
+// skiers and the construction of the descent index, with each layout. The
+// maps of the Data folder all fit in the cache, so they can be scaled up
+// (mirrored copies of the map laid side by side) to see the effect of the
+// layout on maps much larger than the cache.
+//
+// Usage: layout_benchmark [-s <scale>] [-n <skiers>] <map file>...
+
+// Build a map `scale` times taller and wider, out of mirrored copies of a map
+void scaleMap(const ElevationMap& map, int scale, ElevationMap& scaled);
+// Time the descents of skiers from the given start points; sets checksum to the total path length
+double timeDescents(const ElevationMap& map, const std::vector<std::pair<int, int>>& starts, size_t& checksum);
+// Time the construction of the descent index
+double timeIndex(const ElevationMap& map);
+
+int main(int argc, char* argv[]) {
+    int scale = 1;
+    size_t numSkiers = 10000;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        std::string option = argv[arg];
+        if (option == "-s") {
+            scale = atoi(argv[++arg]);
+        } else if (option == "-n") {
+            numSkiers = strtoul(argv[++arg], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return EXIT_FAILURE;
+        }
+        arg++;
+    }
+    if (arg >= argc || scale < 1) {
+        std::cerr << "Usage: " << argv[0] << " [-s <scale>] [-n <skiers>] <map file>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << std::left << std::setw(20) << "map" << std::right << std::setw(8) << "rows" << std::setw(8) << "cols"
+              << std::setw(12) << "layout" << std::setw(14) << "descents(ms)" << std::setw(12) << "index(ms)" << std::endl;
+    for (; arg < argc; arg++) {
+        ElevationMap original;
+        if (!readMap(argv[arg], original)) {
+            std::cerr << "Could not read map " << argv[arg] << std::endl;
+            continue;
+        }
+        ElevationMap rowMajor;
+        scaleMap(original, scale, rowMajor);
+        ElevationMap tiled;
+        scaleMap(original, scale, tiled);
+        tileMap(tiled);
+
+        // The same skiers for both layouts
+        std::mt19937 random(412);
+        std::vector<std::pair<int, int>> starts(numSkiers);
+        for (auto& start : starts) {
+            start = {(int)(random() % rowMajor.rows), (int)(random() % rowMajor.cols)};
+        }
+
+        const std::string mapName = extractMapName(argv[arg]);
+        size_t rowMajorChecksum = 0, tiledChecksum = 0;
+        const std::pair<const char*, const ElevationMap*> layouts[] = {{"row-major", &rowMajor}, {"tiled", &tiled}};
+        for (const auto& [layout, map] : layouts) {
+            double descentTime = timeDescents(*map, starts, map == &tiled ? tiledChecksum : rowMajorChecksum);
+            double indexTime = timeIndex(*map);
+            std::cout << std::left << std::setw(20) << mapName << std::right << std::setw(8) << map->rows << std::setw(8)
+                      << map->cols << std::setw(12) << layout << std::fixed << std::setprecision(2) << std::setw(14)
+                      << descentTime << std::setw(12) << indexTime << std::endl;
+        }
+        if (rowMajorChecksum != tiledChecksum) {
+            std::cerr << "The layouts disagree on " << mapName << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    return 0;
+}
+
+void scaleMap(const ElevationMap& map, int scale, ElevationMap& scaled) {
+    scaled.rows = map.rows * scale;
+    scaled.cols = map.cols * scale;
+    scaled.storage.assign((size_t)scaled.rows * scaled.cols, 0.f);
+    scaled.cells = scaled.storage.data();
+    for (int row = 0; row < scaled.rows; row++) {
+        int copyRow = row / map.rows;
+        int sourceRow = (copyRow % 2 == 0) ? row % map.rows : map.rows - 1 - row % map.rows;
+        for (int col = 0; col < scaled.cols; col++) {
+            int copyCol = col / map.cols;
+            int sourceCol = (copyCol % 2 == 0) ? col % map.cols : map.cols - 1 - col % map.cols;
+            scaled.storage[(size_t)row * scaled.cols + col] = map.at(sourceRow, sourceCol);
+        }
+    }
+}
+
+double timeDescents(const ElevationMap& map, const std::vector<std::pair<int, int>>& starts, size_t& checksum) {
+    auto begin = std::chrono::steady_clock::now();
+    checksum = 0;
+    for (const auto& start : starts) {
+        checksum += steepestDescent(map, start.first, start.second).size();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
+
+double timeIndex(const ElevationMap& map) {
+    auto begin = std::chrono::steady_clock::now();
+    DescentIndex index;
+    buildDescentIndex(map, index);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+}
@@ -0,0 +1,211 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../Version4/elevationMap.h"
+#include "../Version4/descentIndex.h"
+#include "../Version4/binaryMap.h"
+#include "../Version4/descentField.h"
+#include "../Version4/skierDispatcher.h"
+
+// Benchmark suite.
+//
+// For each map, times the phases of a skier dispatcher: loading the map,
+// building its descent index, and running tasks of 1, 100, 10k and 1M skiers
+// in TRACE and NO_TRACE. The start points of a task are drawn from a fixed
+// seed, so that every run of the suite asks the same questions. Each task is
+// run in up to three modes:
+//   fork     the Version 3 skier dispatcher, one process per skier (its time
+//            includes reading the map, as it does for every task)
+//   pool     the Version 4 worker threads, searching the map
+//   indexed  the Version 4 worker threads, answering from the descent index
+// Binary maps (.bmap) are only run in pool mode, following their descent
+// field (the load time then includes opening or computing the field).
+//
+// The results go to the standard output as CSV, one line per map, mode,
+// trace mode and number of skiers.
+//
+// Usage: suite_benchmark [-v3 <prog05v3>] [-f <max fork skiers>] [-s <seed>] [-o <scratch folder>] <map file>...
+// Without -v3, the fork mode is left out. Tasks of more than `max fork
+// skiers` (10000 by default) are not run in fork mode, as every skier
+// is a process.
+
+const size_t SKIER_COUNTS[] = {1, 100, 10000, 1000000};
+
+struct SuiteOptions {
+    std::string prog05v3;      // fork mode, if given
+    size_t maxForkSkiers = 10000;
+    uint64_t seed = 412;
+    std::string scratchFolder = "/tmp";
+};
+
+// Milliseconds since a given time
+double millisecondsSince(std::chrono::steady_clock::time_point begin);
+// Run the Version 3 skier dispatcher on a task; returns its wall time (ms), or -1 if it failed
+double timeForkTask(const SuiteOptions& options, const Task& task);
+// Print one line of results
+void printResult(const std::string& mapName, const ElevationMap& map, const char* mode, const Task& task, double loadTime,
+                 double indexTime, double runTime);
+
+int main(int argc, char* argv[]) {
+    SuiteOptions options;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        std::string option = argv[arg];
+        if (option == "-v3") {
+            options.prog05v3 = argv[++arg];
+        } else if (option == "-f") {
+            options.maxForkSkiers = strtoul(argv[++arg], nullptr, 10);
+        } else if (option == "-s") {
+            options.seed = strtoull(argv[++arg], nullptr, 10);
+        } else if (option == "-o") {
+            options.scratchFolder = argv[++arg];
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return EXIT_FAILURE;
+        }
+        arg++;
+    }
+    if (arg >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [-v3 <prog05v3>] [-f <max fork skiers>] [-s <seed>] [-o <scratch folder>]"
+                  << " <map file>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "map,rows,cols,mode,trace,skiers,load_ms,index_ms,run_ms,skiers_per_s" << std::endl;
+    for (; arg < argc; arg++) {
+        const std::string mapFilePath = argv[arg];
+        const std::string mapName = extractMapName(mapFilePath);
+        const bool binary = isBinaryMap(mapFilePath);
+        const std::string outputFilePath = options.scratchFolder + "/" + mapName + ".txt";
+
+        ResidentMap map;
+        auto begin = std::chrono::steady_clock::now();
+        bool loaded;
+        if (binary) {
+            loaded = openBinaryMap(mapFilePath, map.elevations) && loadDescentField(map.elevations, mapFilePath, map.field);
+            map.outOfCore = true;
+        } else {
+            loaded = readMap(mapFilePath, map.elevations);
+        }
+        const double loadTime = millisecondsSince(begin);
+        if (!loaded) {
+            std::cerr << "Could not load map " << mapFilePath << std::endl;
+            continue;
+        }
+        double indexTime = 0.0;
+        if (!binary) {
+            begin = std::chrono::steady_clock::now();
+            buildDescentIndex(map.elevations, map.index);
+            indexTime = millisecondsSince(begin);
+        }
+
+        for (size_t numSkiers : SKIER_COUNTS) {
+            // The same start points for every mode, and for both trace modes
+            std::mt19937_64 random(options.seed ^ numSkiers);
+            Task task;
+            task.mapFilePath = mapFilePath;
+            task.mapName = mapName;
+            task.points.resize(numSkiers);
+            for (auto& point : task.points) {
+                point = {(int)(random() % map.elevations.rows), (int)(random() % map.elevations.cols)};
+            }
+
+            for (bool traceMode : {true, false}) {
+                task.traceMode = traceMode;
+                if (!options.prog05v3.empty() && !binary && numSkiers <= options.maxForkSkiers) {
+                    double runTime = timeForkTask(options, task);
+                    if (runTime >= 0.0) {
+                        printResult(mapName, map.elevations, "fork", task, -1.0, -1.0, runTime);
+                    }
+                }
+
+                SkierDispatcherOptions dispatcherOptions;
+                dispatcherOptions.useIndex = false;
+                map.indexed = false;
+                begin = std::chrono::steady_clock::now();
+                if (runTask(map, task, outputFilePath, dispatcherOptions)) {
+                    printResult(mapName, map.elevations, "pool", task, loadTime, -1.0, millisecondsSince(begin));
+                }
+
+                if (!binary) {
+                    dispatcherOptions.useIndex = true;
+                    map.indexed = true;
+                    begin = std::chrono::steady_clock::now();
+                    if (runTask(map, task, outputFilePath, dispatcherOptions)) {
+                        printResult(mapName, map.elevations, "indexed", task, loadTime, indexTime, millisecondsSince(begin));
+                    }
+                }
+                unlink(outputFilePath.c_str());
+            }
+        }
+    }
+    return 0;
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+double timeForkTask(const SuiteOptions& options, const Task& task) {
+    // The start points go through a points file (1-based, as in a task file)
+    const std::string pointsFilePath = options.scratchFolder + "/" + task.mapName + ".points";
+    {
+        std::ofstream pointsFile(pointsFilePath);
+        pointsFile << task.points.size() << "\n";
+        for (const auto& point : task.points) {
+            pointsFile << point.first + 1 << " " << point.second + 1 << "\n";
+        }
+        if (!pointsFile) {
+            return -1.0;
+        }
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        const std::string outputFolder = options.scratchFolder + "/";
+        if (task.traceMode) {
+            execl(options.prog05v3.c_str(), options.prog05v3.c_str(), "-t", "-f", pointsFilePath.c_str(),
+                  task.mapFilePath.c_str(), outputFolder.c_str(), (char*)nullptr);
+        } else {
+            execl(options.prog05v3.c_str(), options.prog05v3.c_str(), "-f", pointsFilePath.c_str(),
+                  task.mapFilePath.c_str(), outputFolder.c_str(), (char*)nullptr);
+        }
+        _exit(127);
+    }
+    int status = 0;
+    bool succeeded = pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    double runTime = millisecondsSince(begin);
+    unlink(pointsFilePath.c_str());
+    if (!succeeded) {
+        std::cerr << "prog05v3 failed on " << task.mapName << std::endl;
+        return -1.0;
+    }
+    return runTime;
+}
+
+void printResult(const std::string& mapName, const ElevationMap& map, const char* mode, const Task& task, double loadTime,
+                 double indexTime, double runTime) {
+    // Phases a mode does not have are left empty
+    auto phase = [](double time) {
+        if (time < 0.0) {
+            return std::string();
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "%.3f", time);
+        return std::string(text);
+    };
+    std::cout << mapName << "," << map.rows << "," << map.cols << "," << mode << ","
+              << (task.traceMode ? "TRACE" : "NO_TRACE") << "," << task.points.size() << "," << phase(loadTime) << ","
+              << phase(indexTime) << "," << phase(runTime) << "," << std::fixed << std::setprecision(0)
+              << task.points.size() / (runTime / 1000.0) << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "../Version4/binaryMap.h"
+
+// Map converter.
+//
+// Converts a text map ("rows cols" header followed by the elevations) to the
+// binary, tiled format the Version 4 dispatcher maps instead of reading
+// (.bmap), for maps too large to be read into memory. The text map is
+// streamed, so it can be larger than memory too.
+//
+// Usage: convert_map <text map> <binary map>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <text map> <binary map>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!isBinaryMap(argv[2])) {
+        std::cerr << "A binary map must have the .bmap extension: " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!convertMap(argv[1], argv[2])) {
+        std::cerr << "Failed to convert " << argv[1] << " to " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
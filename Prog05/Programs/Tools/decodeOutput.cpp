@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+
+#include "../Version4/binaryOutput.h"
+
+// Output decoder.
+//
+// Converts a binary output file (.bout, written by the Version 4 dispatcher
+// with --binary-output) to the text output the same task writes without it,
+// byte for byte. The binary file is mapped and read a record at a time, so it
+// can be larger than memory.
+//
+// Usage: decode_output <binary output> <text output>
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <binary output> <text output>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!isBinaryOutput(argv[1])) {
+        std::cerr << "A binary output file must have the .bout extension: " << argv[1] << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!convertBinaryOutput(argv[1], argv[2])) {
+        std::cerr << "Failed to decode " << argv[1] << " to " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
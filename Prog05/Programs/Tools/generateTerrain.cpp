@@ -0,0 +1,254 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../Version4/binaryMap.h"
+#include "../Version4/resultWriter.h"
+
+// Terrain generator.
+//
+// Generates synthetic maps for the scaling benchmarks, from 1K x 1K cells (as
+// large as the largest maps of the Data folder) up to 64K x 64K, as text maps
+// or binary maps (.bmap, by the extension of the output file). The terrain is
+// fractal value noise: octaves of random heights on coarser and coarser
+// grids, interpolated and summed, the finest octaves weighing the least.
+//
+// Every elevation is a function of the seed and of its position only, so a
+// map is the same whatever the number of threads generating it, and the text
+// and binary maps of a seed hold the same elevations. Elevations have two
+// decimals and span less than 655.36, so the maps can be stored in fixed point.
+//
+// Options:
+//   -s <seed>           seed of the terrain (default 1)
+//   -f <feature size>   period of the coarsest octave, in cells (default 512)
+//   -p <plateau share>  share (0 to 1) of each 25.00 step of elevation that is
+//                       flattened into a plateau (default 0, no plateaus)
+//   -q <step>           round the elevations to a multiple of the step, making
+//                       many neighbors equal (default 0.01)
+//
+// Usage: generate_terrain [options] <size> <Sq|Horiz|Vert> <output map>
+// The size is the longest side of the map, in cells (a K suffix multiplies it
+// by 1024). Horiz and Vert maps have the proportions of those of the Data
+// folder (4:5 and 5:4.2).
+
+const double ELEVATION_RANGE = 600.0;  // elevations go from 0 to below this
+const double PERSISTENCE = 0.5;        // weight of an octave against the previous one
+const int MIN_PERIOD = 8;              // period of the finest octave, in cells
+const double TERRACE_STEP = 25.0;      // height of the steps the plateaus are cut in
+const size_t CELLS_PER_BLOCK = 1 << 20; // cells of the text map formatted per block
+const size_t BLOCKS_AHEAD_PER_WORKER = 2;
+
+struct TerrainParameters {
+    uint64_t seed = 1;
+    int featureSize = 512;
+    double plateauShare = 0.0;
+    int tieStep = 1; // in hundredths
+};
+
+// Parse a size, with an optional K suffix; 0 if invalid
+int parseSize(const std::string& text);
+// Elevations (in hundredths) of `count` cells of a row, from column `col` on
+void terrainRow(const TerrainParameters& terrain, int row, int col, int count, int32_t* hundredths);
+// Write a text map, formatted by several threads and written in order
+bool writeTextMap(const TerrainParameters& terrain, int rows, int cols, const std::string& mapFilePath);
+
+int main(int argc, char* argv[]) {
+    TerrainParameters terrain;
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        std::string option = argv[arg];
+        if (option == "-s") {
+            terrain.seed = strtoull(argv[++arg], nullptr, 10);
+        } else if (option == "-f") {
+            terrain.featureSize = atoi(argv[++arg]);
+        } else if (option == "-p") {
+            terrain.plateauShare = atof(argv[++arg]);
+        } else if (option == "-q") {
+            terrain.tieStep = (int)std::lround(atof(argv[++arg]) * 100.0);
+        } else {
+            break;
+        }
+        arg++;
+    }
+    if (argc - arg != 3) {
+        std::cerr << "Usage: " << argv[0] << " [-s <seed>] [-f <feature size>] [-p <plateau share>] [-q <step>]"
+                  << " <size> <Sq|Horiz|Vert> <output map>" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (terrain.featureSize < MIN_PERIOD || terrain.plateauShare < 0.0 || terrain.plateauShare >= 1.0 ||
+        terrain.tieStep < 1) {
+        std::cerr << "Invalid terrain options" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int size = parseSize(argv[arg]);
+    std::string shape = argv[arg + 1];
+    std::string mapFilePath = argv[arg + 2];
+    int rows = size, cols = size;
+    if (shape == "Horiz") {
+        rows = std::max(1, size * 4 / 5);
+    } else if (shape == "Vert") {
+        cols = std::max(1, size * 21 / 25);
+    } else if (shape != "Sq") {
+        size = 0;
+    }
+    if (size <= 0) {
+        std::cerr << "Invalid map size or shape: " << argv[arg] << " " << shape << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bool written;
+    if (isBinaryMap(mapFilePath)) {
+        written = createBinaryMap(mapFilePath, rows, cols, [&terrain](int row, int col, int count, float* elevations) {
+            int32_t hundredths[MAP_TILE_SIZE];
+            for (int done = 0; done < count; done += MAP_TILE_SIZE) {
+                int chunk = std::min(MAP_TILE_SIZE, count - done);
+                terrainRow(terrain, row, col + done, chunk, hundredths);
+                // The float closest to the decimal elevation, as read from a text map
+                for (int i = 0; i < chunk; i++) {
+                    elevations[done + i] = (float)hundredths[i] / 100.0f;
+                }
+            }
+        });
+    } else {
+        written = writeTextMap(terrain, rows, cols, mapFilePath);
+    }
+    if (!written) {
+        std::cerr << "Failed to write " << mapFilePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
+
+int parseSize(const std::string& text) {
+    char* end;
+    long size = strtol(text.c_str(), &end, 10);
+    if (*end == 'K' || *end == 'k') {
+        size *= 1024;
+        end++;
+    }
+    if (*end != '\0' || size <= 0 || size > 1 << 20) {
+        return 0;
+    }
+    return (int)size;
+}
+
+// Mix the bits of a 64-bit value (the splitmix64 finalizer)
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Random height (0 to 1) of a grid point of an octave
+static double latticeHeight(uint64_t seed, int octave, int x, int y) {
+    uint64_t point = (uint64_t)octave << 56 | (uint64_t)(uint32_t)y << 28 | (uint32_t)x;
+    return (mix(seed ^ mix(point)) >> 11) * 0x1.0p-53;
+}
+
+// Smooth interpolation weight, for a position (0 to 1) between two grid points
+static double smooth(double t) {
+    return t * t * (3.0 - 2.0 * t);
+}
+
+void terrainRow(const TerrainParameters& terrain, int row, int col, int count, int32_t* hundredths) {
+    std::vector<double> height(count, 0.0);
+    double totalWeight = 0.0;
+    double weight = 1.0;
+    int octave = 0;
+    for (int period = terrain.featureSize; period >= MIN_PERIOD; period /= 2, octave++) {
+        const int y = row / period;
+        const double sy = smooth((double)(row % period) / period);
+        // The grid points around a cell only change every `period` cells
+        int x = -1;
+        double top0 = 0.0, top1 = 0.0, bottom0 = 0.0, bottom1 = 0.0;
+        for (int i = 0; i < count; i++) {
+            if ((col + i) / period != x) {
+                x = (col + i) / period;
+                top0 = latticeHeight(terrain.seed, octave, x, y);
+                top1 = latticeHeight(terrain.seed, octave, x + 1, y);
+                bottom0 = latticeHeight(terrain.seed, octave, x, y + 1);
+                bottom1 = latticeHeight(terrain.seed, octave, x + 1, y + 1);
+            }
+            const double sx = smooth((double)((col + i) % period) / period);
+            double top = top0 + (top1 - top0) * sx;
+            double bottom = bottom0 + (bottom1 - bottom0) * sx;
+            height[i] += weight * (top + (bottom - top) * sy);
+        }
+        totalWeight += weight;
+        weight *= PERSISTENCE;
+    }
+
+    for (int i = 0; i < count; i++) {
+        double elevation = height[i] / totalWeight * ELEVATION_RANGE;
+        if (terrain.plateauShare > 0.0) {
+            // Flatten the lower part of each step, and stretch the rest over the whole step
+            double level = std::floor(elevation / TERRACE_STEP);
+            double rise = elevation / TERRACE_STEP - level;
+            rise = rise < terrain.plateauShare ? 0.0 : (rise - terrain.plateauShare) / (1.0 - terrain.plateauShare);
+            elevation = (level + rise) * TERRACE_STEP;
+        }
+        int64_t steps = std::llround(elevation * 100.0 / terrain.tieStep);
+        hundredths[i] = (int32_t)std::min<int64_t>(steps * terrain.tieStep, (int64_t)(ELEVATION_RANGE * 100.0) - 1);
+    }
+}
+
+// Append an elevation given in hundredths, with two decimals
+static void appendElevation(std::string& output, int32_t hundredths) {
+    output += std::to_string(hundredths / 100);
+    output += '.';
+    output += (char)('0' + hundredths / 10 % 10);
+    output += (char)('0' + hundredths % 10);
+}
+
+bool writeTextMap(const TerrainParameters& terrain, int rows, int cols, const std::string& mapFilePath) {
+    int fd = open(mapFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    std::string header = std::to_string(rows) + "\t" + std::to_string(cols) + "\n";
+    std::vector<struct iovec> buffers = {{header.data(), header.size()}};
+    bool written = writeBuffers(fd, buffers);
+
+    // Blocks of whole rows, taken by the workers in turn
+    const size_t rowsPerBlock = std::max<size_t>(1, CELLS_PER_BLOCK / cols);
+    const size_t numBlocks = (rows + rowsPerBlock - 1) / rowsPerBlock;
+    const size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    OrderedResultWriter writer(fd, numWorkers * BLOCKS_AHEAD_PER_WORKER);
+    std::atomic<size_t> nextBlock{0};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers && written; w++) {
+        workers.emplace_back([&]() {
+            std::vector<int32_t> hundredths(cols);
+            size_t block;
+            while ((block = nextBlock.fetch_add(1)) < numBlocks) {
+                std::string output;
+                size_t end = std::min((size_t)rows, (block + 1) * rowsPerBlock);
+                for (size_t row = block * rowsPerBlock; row < end; row++) {
+                    terrainRow(terrain, (int)row, 0, cols, hundredths.data());
+                    for (int col = 0; col < cols; col++) {
+                        appendElevation(output, hundredths[col]);
+                        output += col + 1 < cols ? '\t' : '\n';
+                    }
+                }
+                writer.submit(block, output, true);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    written = written && writer.finish();
+    return close(fd) == 0 && written;
+}
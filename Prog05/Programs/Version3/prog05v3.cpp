@@ -7,6 +7,44 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <climits>
+#include <sys/uio.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <sys/resource.h>
+
+// Number of skiers forked at a time: their results are written out before the
+// next ones are launched, so memory and open pipes don't grow with the task size
+const size_t SKIER_CHUNK_SIZE = 256;
+
+// Results are written as soon as they (and all the results before them) are
+// complete. The result at the head of the output is also written as it comes,
+// whenever this much of it has piled up (long traces).
+const size_t STREAMING_FLUSH_SIZE = 1 << 16;
+
+// Timings (in milliseconds) and counters of a run, for --stats. There is no
+// index in this version: every skier searches the map.
+struct RunStats {
+    double parseMs = 0.0;  // arguments and start points
+    double mapMs = 0.0;
+    double queryMs = 0.0;  // forking the skiers and collecting their results
+    double outputMs = 0.0; // writing the output file
+    unsigned long long skiers = 0; // with a valid start point
+    unsigned long long steps = 0;
+    long long maxPathLength = 0;
+    unsigned long long bytesWritten = 0;
+};
+
+// Buffered reader for start points given in a file or on the standard input
+struct PointStream {
+    int fd = -1;
+    char buffer[1 << 16];
+    size_t position = 0; // next byte to parse
+    size_t length = 0;   // bytes in the buffer
+};
 
 // Read in the map to a 2D vector
 bool readMap(const std::string& filePath, std::vector<std::vector<float>>& map, int& rows, int& cols);
@@ -18,14 +56,27 @@ std::vector<std::pair<int, int>> steepestDescent(const std::vector<std::vector<f
 std::string extractMapName(const std::string& mapFilePath);
 // Display the errors to the program output
 void show_error(std::string outputFolderPath,std::string fileName, std::string Output_String);
-//
-void parseArguments(int argc, char *argv[], bool& traceMode, std::string& mapFilePath, std::vector<std::pair<int,int>>& List_of_Points, std::string& outputFolderPath,int number_of_starting_points);
+// Reads the arguments: [--stats[=json]] [-t] <map> <row col>... <output folder>, or [--stats[=json]] [-t] -f <points file> <map> <output folder>
+void parseArguments(int argc, char *argv[], bool& traceMode, std::string& mapFilePath, std::vector<std::pair<int,int>>& List_of_Points, std::string& outputFolderPath, std::string& pointsFilePath, std::string& statsFormat);
+// Opens a points file ("-" for the standard input)
+bool openPointStream(const std::string& pointsFilePath, PointStream& stream);
+// Reads the next integer of a points file
+bool readInteger(PointStream& stream, int& value);
+// Reads up to maxPoints (1-based) "row col" pairs from a points file, as 0-based points
+size_t readPoints(PointStream& stream, std::vector<std::pair<int,int>>& points, size_t maxPoints);
 //
 bool initializeOutputFile(std::ofstream& outFile, bool traceMode, int numberOfStartingPoints);
 //
 void createAndManageProcesses(const std::vector<std::pair<int,int>>& List_of_Points, std::vector<pid_t>& childPIDs, std::vector<int>& pipefds, const std::vector<std::vector<float>>& map, int rows, int cols, bool traceMode);
-//
-void collectAndWriteResults(const std::vector<pid_t>& childPIDs, const std::vector<int>& pipefds, const std::string& Combined_Output,std::ofstream& outFile);
+// Reads the skiers' pipes as they fill up and writes their results, in start point order, to the combined output.
+// Counts the skiers and the time spent writing in stats, if given.
+void collectAndWriteResults(const std::vector<pid_t>& childPIDs, const std::vector<int>& pipefds, int outFd, RunStats* stats);
+// Milliseconds since a given time
+double millisecondsSince(std::chrono::steady_clock::time_point begin);
+// Prints the statistics of a run on the standard error, as text or JSON
+void printRunStats(const std::string& fileName, const RunStats& stats, const std::string& statsFormat);
+// Writes a list of buffers to a file, with as few system calls as possible
+bool writeBuffers(int fd, std::vector<struct iovec>& buffers);
 
 
 
@@ -35,35 +86,97 @@ int main(int argc, char *argv[]) {
     std::string mapFilePath; // Like to the map path
     std::vector<std::pair<int,int>> List_of_Points;
     std::string outputFolderPath; // Stores the path to the output folder 
-    int number_of_starting_points = argc - 3;
+    std::string pointsFilePath; // Where to stream the start points from, if not in the arguments
     std::vector<std::vector<float>> map; // Stores the map vector 
     int rows, cols; // Stores the rows and cols
     std::vector<pid_t> childPIDs;
     std::vector<int> pipefds; // Vector to store file descriptors for pipes
+    std::string statsFormat; // "text" or "json" with --stats, empty otherwise
+    RunStats stats;
     
-    parseArguments(argc, argv, traceMode, mapFilePath, List_of_Points, outputFolderPath,number_of_starting_points);
+    auto phaseStart = std::chrono::steady_clock::now();
+    parseArguments(argc, argv, traceMode, mapFilePath, List_of_Points, outputFolderPath, pointsFilePath, statsFormat);
+    stats.parseMs = millisecondsSince(phaseStart);
 
     // Gets the name of the files
     std::string fileName = extractMapName(mapFilePath);
     const std::string Combined_Output = (outputFolderPath + "/" + fileName + ".txt");
 
     // reads the map and exits if the file isnt able to be opened
+    phaseStart = std::chrono::steady_clock::now();
     if(!readMap(mapFilePath, map, rows, cols)){
         show_error((Combined_Output),fileName, "File not found");
         exit(12);
     }
+    stats.mapMs = millisecondsSince(phaseStart);
+
+    // A points file starts with the number of points, like the end of a task file
+    PointStream pointStream;
+    int number_of_starting_points = List_of_Points.size();
+    if (!pointsFilePath.empty()) {
+        if (!openPointStream(pointsFilePath, pointStream) || !readInteger(pointStream, number_of_starting_points)) {
+            std::cerr << "Failed to read the start points from " << pointsFilePath << std::endl;
+            exit(5);
+        }
+    }
 
     std::ofstream outFile(Combined_Output);
 
-    if(!initializeOutputFile(outFile, traceMode, List_of_Points.size())){
+    if(!initializeOutputFile(outFile, traceMode, number_of_starting_points)){
         exit(11);
     }
 
-    // Create and manage processes
-    createAndManageProcesses(List_of_Points, childPIDs, pipefds, map, rows, cols, traceMode);
+    // Open the final output file once, for all the chunks
+    int outFd = open(Combined_Output.c_str(), O_WRONLY | O_APPEND);
+    if (outFd == -1) {
+        std::cerr << "Failed to open final output file in append mode." << std::endl;
+        exit(4);
+    }
+    stats.bytesWritten = lseek(outFd, 0, SEEK_END); // the header
+
+    // Run the skiers one chunk at a time, writing out each chunk's results as it completes
+    RunStats* measured = statsFormat.empty() ? nullptr : &stats;
+    std::vector<std::pair<int,int>> chunk;
+    size_t pointsDone = 0;
+    while (true) {
+        phaseStart = std::chrono::steady_clock::now();
+        chunk.clear();
+        if (pointsFilePath.empty()) {
+            size_t end = std::min(List_of_Points.size(), pointsDone + SKIER_CHUNK_SIZE);
+            chunk.assign(List_of_Points.begin() + pointsDone, List_of_Points.begin() + end);
+        } else if ((size_t)number_of_starting_points > pointsDone) {
+            size_t remaining = (size_t)number_of_starting_points - pointsDone;
+            readPoints(pointStream, chunk, std::min(remaining, SKIER_CHUNK_SIZE));
+        }
+        stats.parseMs += millisecondsSince(phaseStart);
+        if (chunk.empty()) {
+            break;
+        }
+
+        // Create and manage processes
+        phaseStart = std::chrono::steady_clock::now();
+        childPIDs.clear();
+        pipefds.clear();
+        createAndManageProcesses(chunk, childPIDs, pipefds, map, rows, cols, traceMode);
+
+        collectAndWriteResults(childPIDs, pipefds, outFd, measured);
+        stats.queryMs += millisecondsSince(phaseStart);
+        pointsDone += chunk.size();
+    }
 
-    collectAndWriteResults(childPIDs, pipefds, Combined_Output,outFile);
+    if (pointsDone != (size_t)number_of_starting_points) {
+        std::cerr << "Expected " << number_of_starting_points << " start points, got " << pointsDone << std::endl;
+    }
+    if (pointStream.fd > STDIN_FILENO) {
+        close(pointStream.fd);
+    }
+    close(outFd);
 
+    if (measured != nullptr) {
+        // The output time was counted in with the skiers
+        stats.queryMs -= stats.outputMs;
+        printRunStats(fileName, stats, statsFormat);
+    }
     return 0;
 }
 
@@ -108,30 +221,145 @@ for (int i = 0; i < List_of_Points.size(); i++) {
     }
 }
 
-void collectAndWriteResults(const std::vector<pid_t>& childPIDs, const std::vector<int>& pipefds, const std::string& Combined_Output,std::ofstream& outFile){
-    // Open the final output file once
-    outFile.open(Combined_Output, std::ios_base::app);
-    if (!outFile.is_open()) {
-        std::cerr << "Failed to open final output file in append mode." << std::endl;
-        exit(4);
+void collectAndWriteResults(const std::vector<pid_t>& childPIDs, const std::vector<int>& pipefds, int outFd, RunStats* stats){
+    const size_t numSkiers = pipefds.size();
+    std::vector<std::string> results(numSkiers); // what each skier has sent so far (and isn't written yet)
+    std::vector<bool> complete(numSkiers, false); // skier closed its pipe
+    std::vector<bool> counted(numSkiers, false); // first line of the result seen (--stats)
+    size_t nextToWrite = 0; // all the results before this one have been written
+
+    // All the pipes are watched at once: a skier with a long trace must not
+    // block on a full pipe while we wait for another one.
+    std::vector<struct pollfd> pipes(numSkiers);
+    for (size_t i = 0; i < numSkiers; ++i) {
+        pipes[i] = {pipefds[i], POLLIN, 0};
+    }
+    size_t openPipes = numSkiers;
+
+    while (nextToWrite < numSkiers) {
+        if (openPipes > 0 && poll(pipes.data(), numSkiers, -1) == -1 && errno != EINTR) {
+            std::cerr << "Failed to wait for the skiers' results" << std::endl;
+            exit(4);
+        }
+
+        for (size_t i = 0; i < numSkiers; ++i) {
+            if (pipes[i].fd == -1 || pipes[i].revents == 0) {
+                continue;
+            }
+            // Read straight into the skier's result buffer
+            size_t size = results[i].size();
+            results[i].resize(size + STREAMING_FLUSH_SIZE);
+            ssize_t bytes_read = read(pipes[i].fd, results[i].data() + size, STREAMING_FLUSH_SIZE);
+            results[i].resize(size + (bytes_read > 0 ? bytes_read : 0));
+            if (bytes_read == 0 || (bytes_read < 0 && errno != EINTR && errno != EAGAIN)) {
+                close(pipes[i].fd); // Close the read end of the pipe
+                pipes[i].fd = -1;
+                complete[i] = true;
+                openPipes--;
+            }
+            // The first line of a result ends with the length of the path
+            // (an invalid start point gets a message instead)
+            if (stats != nullptr && !counted[i] && results[i].find('\n') != std::string::npos) {
+                counted[i] = true;
+                long long pathLength = 0;
+                if (results[i].compare(0, 5, "Start") != 0 &&
+                    sscanf(results[i].c_str(), "%*d %*d %*d %*d %lld", &pathLength) == 1) {
+                    stats->skiers++;
+                    stats->steps += pathLength - 1;
+                    stats->maxPathLength = std::max(stats->maxPathLength, pathLength);
+                }
+            }
+        }
+
+        // Write every complete result at the head of the output, and what we
+        // have of the next one if it is getting large
+        std::vector<struct iovec> ready;
+        size_t last = nextToWrite;
+        while (last < numSkiers && complete[last]) {
+            ready.push_back({results[last].data(), results[last].size()});
+            last++;
         }
+        bool partial = last < numSkiers && results[last].size() >= STREAMING_FLUSH_SIZE;
+        if (partial) {
+            ready.push_back({results[last].data(), results[last].size()});
+        }
+        auto writeStart = std::chrono::steady_clock::now();
+        if (stats != nullptr) {
+            for (const auto& buffer : ready) {
+                stats->bytesWritten += buffer.iov_len;
+            }
+        }
+        if (!ready.empty() && !writeBuffers(outFd, ready)) {
+            std::cerr << "Failed to write to the final output file." << std::endl;
+            exit(4);
+        }
+        if (stats != nullptr) {
+            stats->outputMs += millisecondsSince(writeStart);
+        }
+
+        for (; nextToWrite < last; ++nextToWrite) {
+            std::string().swap(results[nextToWrite]); // release the memory
+        }
+        if (partial) {
+            results[last].clear();
+        }
+    }
 
     for (size_t i = 0; i < childPIDs.size(); ++i) {
         int status;
-        pid_t pid = waitpid(childPIDs[i], &status, 0); // Wait for the specific child process to terminate
-
-        // Read from the pipe
-        char buffer[4096]; // Adjust size as necessary
-        ssize_t bytes_read = read(pipefds[i], buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0'; // Null-terminate the string
-            outFile << buffer; // Write to the final output file
-        }
+        waitpid(childPIDs[i], &status, 0); // Wait for the specific child process to terminate
+    }
+}
+
+double millisecondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
 
-        close(pipefds[i]); // Close the read end of the pipe
+void printRunStats(const std::string& fileName, const RunStats& stats, const std::string& statsFormat) {
+    // Peak memory of the dispatcher, or of its largest skier
+    long peakRssKb = 0;
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        peakRssKb = usage.ru_maxrss;
     }
+    if (getrusage(RUSAGE_CHILDREN, &usage) == 0) {
+        peakRssKb = std::max(peakRssKb, usage.ru_maxrss);
+    }
+    double averagePathLength = stats.skiers > 0 ? 1.0 + (double)stats.steps / stats.skiers : 0.0;
+    if (statsFormat == "json") {
+        fprintf(stderr, "{\"map\":\"%s\",\"parse_ms\":%.3f,\"map_ms\":%.3f,\"index_ms\":0,\"query_ms\":%.3f,"
+                "\"output_ms\":%.3f,\"skiers\":%llu,\"steps\":%llu,\"avg_path_length\":%.2f,\"max_path_length\":%lld,"
+                "\"bytes_written\":%llu,\"peak_rss_kb\":%ld}\n",
+                fileName.c_str(), stats.parseMs, stats.mapMs, stats.queryMs, stats.outputMs, stats.skiers, stats.steps,
+                averagePathLength, stats.maxPathLength, stats.bytesWritten, peakRssKb);
+    } else {
+        fprintf(stderr, "Stats for %s: parse %.3f ms, map %.3f ms, query %.3f ms, output %.3f ms; %llu skiers, %llu steps,"
+                " path length %.2f avg, %lld max; %llu bytes written, peak RSS %ld KB\n",
+                fileName.c_str(), stats.parseMs, stats.mapMs, stats.queryMs, stats.outputMs, stats.skiers, stats.steps,
+                averagePathLength, stats.maxPathLength, stats.bytesWritten, peakRssKb);
+    }
+}
 
-    outFile.close(); // Close the final output file
+bool writeBuffers(int fd, std::vector<struct iovec>& buffers) {
+    size_t first = 0;
+    while (first < buffers.size()) {
+        int count = (int)std::min(buffers.size() - first, (size_t)IOV_MAX);
+        ssize_t written = writev(fd, buffers.data() + first, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        // Skip what was written, which may end in the middle of a buffer
+        while (first < buffers.size() && (size_t)written >= buffers[first].iov_len) {
+            written -= buffers[first].iov_len;
+            first++;
+        }
+        if (first < buffers.size()) {
+            buffers[first].iov_base = static_cast<char*>(buffers[first].iov_base) + written;
+            buffers[first].iov_len -= written;
+        }
+    }
+    return true;
 }
 
 bool initializeOutputFile(std::ofstream& outFile, bool traceMode, int number_of_starting_points){
@@ -152,26 +380,41 @@ bool initializeOutputFile(std::ofstream& outFile, bool traceMode, int number_of_
     return 1;
 }
 
-void parseArguments(int argc, char *argv[], bool& traceMode, std::string& mapFilePath, std::vector<std::pair<int,int>>& List_of_Points, std::string& outputFolderPath,int number_of_starting_points){
+void parseArguments(int argc, char *argv[], bool& traceMode, std::string& mapFilePath, std::vector<std::pair<int,int>>& List_of_Points, std::string& outputFolderPath, std::string& pointsFilePath, std::string& statsFormat){
+    int arg = 1;
+
+    // Timings and counters of the run, on the standard error
+    if (arg < argc && std::string(argv[arg]) == "--stats") {
+        statsFormat = "text";
+        arg++;
+    } else if (arg < argc && std::string(argv[arg]) == "--stats=json") {
+        statsFormat = "json";
+        arg++;
+    }
+
     // Stores the info when trace is true
-    
-    if (std::string(argv[1]) == "-t") {
+    if (arg < argc && std::string(argv[arg]) == "-t") {
         traceMode = true;
-        mapFilePath = argv[2];
-        for (int i = 3; i <= number_of_starting_points; i+=2){
-            List_of_Points.push_back({atoi(argv[i])-1, atoi(argv[i+1])-1});
-        }
-        outputFolderPath = argv[argc-1];
+        arg++;
     }
-    // Stores the info when the trace is false
-    else{
-        mapFilePath = argv[1];
-        for (int i = 2; i <= number_of_starting_points; i+=2){
-            List_of_Points.push_back({atoi(argv[i])-1, atoi(argv[i+1])-1});
-        }
-        outputFolderPath = argv[argc-1];
+    // Start points streamed from a file instead of given as arguments
+    if (arg + 1 < argc && std::string(argv[arg]) == "-f") {
+        pointsFilePath = argv[arg + 1];
+        arg += 2;
     }
 
+    if (argc - arg < 2) {
+        std::cerr << "Usage: " << argv[0] << " [--stats[=json]] [-t] <map> <row col>... <output folder>" << std::endl;
+        std::cerr << "   or: " << argv[0] << " [--stats[=json]] [-t] -f <points file|-> <map> <output folder>" << std::endl;
+        exit(1);
+    }
+
+    mapFilePath = argv[arg++];
+    for (; arg + 1 < argc - 1; arg += 2){
+        List_of_Points.push_back({atoi(argv[arg])-1, atoi(argv[arg+1])-1});
+    }
+    outputFolderPath = argv[argc-1];
+
     if (!outputFolderPath.empty() && outputFolderPath.back() == '/') {
         // Remove the last character
         outputFolderPath.pop_back();
@@ -179,6 +422,57 @@ void parseArguments(int argc, char *argv[], bool& traceMode, std::string& mapFil
 
 }
 
+bool openPointStream(const std::string& pointsFilePath, PointStream& stream) {
+    stream.fd = (pointsFilePath == "-") ? STDIN_FILENO : open(pointsFilePath.c_str(), O_RDONLY);
+    stream.position = 0;
+    stream.length = 0;
+    return stream.fd != -1;
+}
+
+bool readInteger(PointStream& stream, int& value) {
+    bool negative = false;
+    bool started = false;
+    value = 0;
+    while (true) {
+        // Refill the buffer when it runs out
+        if (stream.position == stream.length) {
+            ssize_t bytes_read = read(stream.fd, stream.buffer, sizeof(stream.buffer));
+            if (bytes_read <= 0) {
+                if (negative) {
+                    value = -value;
+                }
+                return started;
+            }
+            stream.position = 0;
+            stream.length = bytes_read;
+        }
+
+        char c = stream.buffer[stream.position];
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+            started = true;
+        } else if (started) {
+            if (negative) {
+                value = -value;
+            }
+            return true; // the separator is left for the next call to skip
+        } else {
+            negative = (c == '-');
+        }
+        stream.position++;
+    }
+}
+
+size_t readPoints(PointStream& stream, std::vector<std::pair<int,int>>& points, size_t maxPoints) {
+    int row, col;
+    size_t count = 0;
+    while (count < maxPoints && readInteger(stream, row) && readInteger(stream, col)) {
+        points.push_back({row - 1, col - 1});
+        count++;
+    }
+    return count;
+}
+
 // Read in the map to a 2D vector
 bool readMap(const std::string& filePath, std::vector<std::vector<float>>& map, int& rows, int& cols) {
     
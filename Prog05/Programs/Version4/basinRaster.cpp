@@ -0,0 +1,106 @@
+#include "basinRaster.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "resultWriter.h"
+
+namespace {
+
+const int MAX_IMAGE_SIDE = 65535; // TGA sizes are 16-bit
+const size_t ROWS_PER_BLOCK = 64; // image rows colored per block
+
+// Write the header and the cells of one raster
+bool writeRaster(const std::string& rasterPath, int rows, int cols, const PlacedVector<int32_t>& cells) {
+    int fd = open(rasterPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    int32_t header[2] = {rows, cols};
+    std::vector<struct iovec> buffers = {{header, sizeof(header)},
+                                         {const_cast<int32_t*>(cells.data()), cells.size() * sizeof(int32_t)}};
+    bool written = writeBuffers(fd, buffers);
+    return close(fd) == 0 && written;
+}
+
+// Color of a basin, from its local minimum (a hash, so that neighboring basins differ)
+void basinColor(int32_t basin, uint8_t color[3]) {
+    uint32_t hash = (uint32_t)basin * 2654435761u;
+    hash ^= hash >> 15;
+    hash *= 2246822519u;
+    hash ^= hash >> 13;
+    for (int channel = 0; channel < 3; channel++) {
+        color[channel] = (uint8_t)(64 + (hash >> (8 * channel)) % 192);
+    }
+}
+
+// Write the image of the basins; the rows are colored in parallel
+bool writeImage(const DescentIndex& index, const std::string& imagePath) {
+    const int rows = index.rows;
+    const int cols = index.cols;
+    if (rows > MAX_IMAGE_SIDE || cols > MAX_IMAGE_SIDE) {
+        return false;
+    }
+    const int32_t maxLength = std::max(2, *std::max_element(index.pathLength.begin(), index.pathLength.end()));
+
+    // Uncompressed true-color image, 24 bits per pixel, stored from the top row down
+    uint8_t header[18] = {};
+    header[2] = 2;
+    header[12] = cols & 0xFF;
+    header[13] = cols >> 8;
+    header[14] = rows & 0xFF;
+    header[15] = rows >> 8;
+    header[16] = 24;
+    header[17] = 0x20;
+
+    std::vector<uint8_t> pixels((size_t)rows * cols * 3);
+    const size_t numBlocks = (rows + ROWS_PER_BLOCK - 1) / ROWS_PER_BLOCK;
+    std::atomic<size_t> nextBlock{0};
+    std::vector<std::thread> workers;
+    size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t w = 0; w < numWorkers; w++) {
+        workers.emplace_back([&]() {
+            size_t block;
+            while ((block = nextBlock.fetch_add(1)) < numBlocks) {
+                size_t first = block * ROWS_PER_BLOCK * cols;
+                size_t end = std::min((size_t)rows, (block + 1) * ROWS_PER_BLOCK) * cols;
+                for (size_t cell = first; cell < end; cell++) {
+                    uint8_t color[3];
+                    basinColor(index.basin[cell], color);
+                    // From 30% of the color at the local minimum to all of it at the longest path
+                    int shade = 77 + 178 * (index.pathLength[cell] - 1) / (maxLength - 1);
+                    for (int channel = 0; channel < 3; channel++) {
+                        pixels[cell * 3 + channel] = (uint8_t)(color[channel] * shade / 255);
+                    }
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    int fd = open(imagePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    std::vector<struct iovec> buffers = {{header, sizeof(header)}, {pixels.data(), pixels.size()}};
+    bool written = writeBuffers(fd, buffers);
+    return close(fd) == 0 && written;
+}
+
+} // namespace
+
+bool writeBasinRasters(const DescentIndex& index, const std::string& outputPathPrefix, bool image) {
+    bool written = writeRaster(outputPathPrefix + ".basin", index.rows, index.cols, index.basin) &&
+                   writeRaster(outputPathPrefix + ".length", index.rows, index.cols, index.pathLength);
+    if (written && image) {
+        written = writeImage(index, outputPathPrefix + ".tga");
+    }
+    return written;
+}
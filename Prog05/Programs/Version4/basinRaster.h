@@ -0,0 +1,25 @@
+#ifndef BASIN_RASTER_H
+#define BASIN_RASTER_H
+
+#include <string>
+
+#include "descentIndex.h"
+
+// Basin rasters: what a skier dropped on each cell of a map gets, for every
+// cell at once, read off the descent index.
+//
+// Two binary rasters are written, <prefix>.basin and <prefix>.length. Each
+// one starts with the rows and the columns of the map (32-bit integers), then
+// has one 32-bit integer per cell, row-major, in the byte order of the
+// machine:
+//  - .basin: the local minimum the cell's path ends at, as a (0-based,
+//    row-major) cell number, so that cells with the same basin share it;
+//  - .length: the number of points on the cell's path, both ends included.
+// An image can also be written, <prefix>.tga (uncompressed 24-bit TGA), with a
+// color per basin, darker the closer a cell is to its local minimum.
+
+// Write the basin rasters (and the image if asked) of an index.
+// Returns false if a file could not be written.
+bool writeBasinRasters(const DescentIndex& index, const std::string& outputPathPrefix, bool image);
+
+#endif // BASIN_RASTER_H
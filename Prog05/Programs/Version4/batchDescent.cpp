@@ -0,0 +1,182 @@
+#include "batchDescent.h"
+#include "descentIndex.h"
+
+#include <cmath>
+#include <climits>
+#include <immintrin.h>
+
+namespace {
+
+const int LANES = 8;  // skiers per vector
+const int GROUPS = 2; // vectors stepped together, to overlap their gathers
+
+// One skier at a time
+void scalarDescent(const ElevationMap& map, const std::pair<int, int>* starts, size_t count, int64_t* ends,
+                   int64_t* lengths) {
+    for (size_t i = 0; i < count; i++) {
+        int row = starts[i].first;
+        int col = starts[i].second;
+        int64_t length = 1;
+        uint8_t d;
+        while ((d = descentDirection(map, row, col)) != LOCAL_MINIMUM) {
+            row += DESCENT_ROW_STEP[d];
+            col += DESCENT_COL_STEP[d];
+            length++;
+        }
+        ends[i] = (int64_t)row * map.cols + col;
+        lengths[i] = length;
+    }
+}
+
+// Skiers in the lanes of one vector
+struct LaneGroup {
+    __m256i row, col, cell, length;
+    __m256i active;       // all ones for a lane with a skier
+    int64_t skier[LANES]; // start point each lane is working on
+};
+
+// Put the next skier of the batch in a lane, or leave it idle
+__attribute__((target("avx2"))) void refill(LaneGroup& group, const ElevationMap& map, const std::pair<int, int>* starts,
+                                            size_t count, size_t& nextSkier, int64_t* ends, int64_t* lengths,
+                                            int doneLanes) {
+    alignas(32) int32_t row[LANES], col[LANES], cell[LANES], length[LANES], active[LANES];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(row), group.row);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(col), group.col);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(cell), group.cell);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(length), group.length);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(active), group.active);
+    for (int lane = 0; lane < LANES; lane++) {
+        if (!(doneLanes & (1 << lane))) {
+            continue;
+        }
+        if (group.skier[lane] >= 0) {
+            ends[group.skier[lane]] = cell[lane];
+            lengths[group.skier[lane]] = length[lane];
+        }
+        if (nextSkier < count) {
+            group.skier[lane] = (int64_t)nextSkier;
+            row[lane] = starts[nextSkier].first;
+            col[lane] = starts[nextSkier].second;
+            cell[lane] = row[lane] * map.cols + col[lane];
+            length[lane] = 1;
+            active[lane] = -1;
+            nextSkier++;
+        } else {
+            group.skier[lane] = -1;
+            row[lane] = col[lane] = cell[lane] = 0;
+            length[lane] = 1;
+            active[lane] = 0;
+        }
+    }
+    group.row = _mm256_load_si256(reinterpret_cast<const __m256i*>(row));
+    group.col = _mm256_load_si256(reinterpret_cast<const __m256i*>(col));
+    group.cell = _mm256_load_si256(reinterpret_cast<const __m256i*>(cell));
+    group.length = _mm256_load_si256(reinterpret_cast<const __m256i*>(length));
+    group.active = _mm256_load_si256(reinterpret_cast<const __m256i*>(active));
+}
+
+// Elevations of the cells of the lanes in mask, fallback in the other lanes.
+// Fixed-point elevations are gathered as the 32-bit words they start (the low
+// half is the elevation) and widened to float, which they convert to exactly,
+// so they compare as the stored integers do.
+template <bool Compact>
+__attribute__((target("avx2"))) inline __m256 gatherElevations(const ElevationMap& map, __m256i cell, __m256i mask,
+                                                               __m256 fallback) {
+    if constexpr (Compact) {
+        const int* words = reinterpret_cast<const int*>(map.compactStorage.data());
+        __m256i raw = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), words, cell, mask, 2);
+        __m256 elevations = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(raw, 16), 16));
+        return _mm256_blendv_ps(fallback, elevations, _mm256_castsi256_ps(mask));
+    } else {
+        return _mm256_mask_i32gather_ps(fallback, map.cells, cell, _mm256_castsi256_ps(mask), 4);
+    }
+}
+
+template <bool Compact>
+__attribute__((target("avx2"))) void avx2Descent(const ElevationMap& map, const std::pair<int, int>* starts,
+                                                 size_t count, int64_t* ends, int64_t* lengths) {
+    const __m256i rows = _mm256_set1_epi32(map.rows);
+    const __m256i cols = _mm256_set1_epi32(map.cols);
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256 infinity = _mm256_set1_ps(INFINITY);
+    __m256i rowStep[8], colStep[8], cellStep[8];
+    for (int d = 0; d < 8; d++) {
+        rowStep[d] = _mm256_set1_epi32(DESCENT_ROW_STEP[d]);
+        colStep[d] = _mm256_set1_epi32(DESCENT_COL_STEP[d]);
+        cellStep[d] = _mm256_set1_epi32(DESCENT_ROW_STEP[d] * map.cols + DESCENT_COL_STEP[d]);
+    }
+
+    size_t nextSkier = 0;
+    LaneGroup groups[GROUPS];
+    for (auto& group : groups) {
+        for (int lane = 0; lane < LANES; lane++) {
+            group.skier[lane] = -1;
+        }
+        group.row = group.col = group.cell = group.active = _mm256_setzero_si256();
+        group.length = one;
+        refill(group, map, starts, count, nextSkier, ends, lengths, (1 << LANES) - 1);
+    }
+
+    for (;;) {
+        bool anyActive = false;
+        for (auto& group : groups) {
+            if (_mm256_testz_si256(group.active, group.active)) {
+                continue;
+            }
+            anyActive = true;
+
+            // Lowest of the cell and its neighbors on the map; a neighbor
+            // replaces the current lowest only if strictly lower
+            __m256 lowest = gatherElevations<Compact>(map, group.cell, group.active, infinity);
+            __m256i best = group.cell;
+            __m256i bestRow = group.row;
+            __m256i bestCol = group.col;
+            for (int d = 0; d < 8; d++) {
+                __m256i row = _mm256_add_epi32(group.row, rowStep[d]);
+                __m256i col = _mm256_add_epi32(group.col, colStep[d]);
+                __m256i onMap = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(row, minusOne), _mm256_cmpgt_epi32(rows, row)),
+                                                 _mm256_and_si256(_mm256_cmpgt_epi32(col, minusOne), _mm256_cmpgt_epi32(cols, col)));
+                onMap = _mm256_and_si256(onMap, group.active);
+                __m256i cell = _mm256_add_epi32(group.cell, cellStep[d]);
+                __m256 elevation = gatherElevations<Compact>(map, cell, onMap, infinity);
+                __m256 lower = _mm256_cmp_ps(elevation, lowest, _CMP_LT_OQ);
+                lowest = _mm256_blendv_ps(lowest, elevation, lower);
+                __m256i lowerLanes = _mm256_castps_si256(lower);
+                best = _mm256_blendv_epi8(best, cell, lowerLanes);
+                bestRow = _mm256_blendv_epi8(bestRow, row, lowerLanes);
+                bestCol = _mm256_blendv_epi8(bestCol, col, lowerLanes);
+            }
+
+            // Lanes that did not move have reached a local minimum
+            __m256i stayed = _mm256_and_si256(_mm256_cmpeq_epi32(best, group.cell), group.active);
+            group.length = _mm256_add_epi32(group.length, _mm256_andnot_si256(stayed, _mm256_and_si256(group.active, one)));
+            group.cell = best;
+            group.row = bestRow;
+            group.col = bestCol;
+            int doneLanes = _mm256_movemask_ps(_mm256_castsi256_ps(stayed));
+            if (doneLanes != 0) {
+                refill(group, map, starts, count, nextSkier, ends, lengths, doneLanes);
+            }
+        }
+        if (!anyActive) {
+            break;
+        }
+    }
+}
+
+} // namespace
+
+void batchDescent(const ElevationMap& map, const std::pair<int, int>* starts, size_t count, int64_t* ends,
+                  int64_t* lengths) {
+    bool vectorizable = map.tileOffsets.empty() && (int64_t)map.rows * map.cols < INT_MAX;
+    if (vectorizable && __builtin_cpu_supports("avx2")) {
+        if (map.compact()) {
+            avx2Descent<true>(map, starts, count, ends, lengths);
+        } else {
+            avx2Descent<false>(map, starts, count, ends, lengths);
+        }
+    } else {
+        scalarDescent(map, starts, count, ends, lengths);
+    }
+}
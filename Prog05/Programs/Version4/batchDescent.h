@@ -0,0 +1,29 @@
+#ifndef BATCH_DESCENT_H
+#define BATCH_DESCENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "elevationMap.h"
+
+// Descent of a batch of skiers at once, for NO_TRACE tasks on maps without a
+// descent index or field.
+//
+// With AVX2, 16 skiers go down together, in two groups of 8 lanes: each step
+// gathers the 8 neighbors of every lane's cell and keeps the lowest, the same
+// way steepestDescent does (same neighbor order, strict comparison). A lane
+// whose skier reaches a local minimum records its result and takes the next
+// skier of the batch, so the lanes stay busy until the batch runs out.
+// Fixed-point maps take the same 8-lane kernel: their elevations are
+// gathered a 32-bit word per cell and widened to float, so they only save
+// resident memory, not gathers. Maps the vector kernel does not handle
+// (tiled, or of 2^31 cells or more), and processors without AVX2, go through
+// the same loop one skier at a time.
+
+// End cell (row-major) and number of points of the path of each (valid,
+// 0-based) start point
+void batchDescent(const ElevationMap& map, const std::pair<int, int>* starts, size_t count, int64_t* ends,
+                  int64_t* lengths);
+
+#endif // BATCH_DESCENT_H
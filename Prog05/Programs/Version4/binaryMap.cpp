@@ -0,0 +1,267 @@
+#include "binaryMap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char BINARY_MAP_MAGIC[8] = "P05BMAP";
+const uint32_t BINARY_MAP_VERSION = 1;
+
+// Header of a binary map. The elevations start on the next page.
+struct BinaryMapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tileSize;   // MAP_TILE_SIZE of the program that wrote the map
+    int32_t rows;
+    int32_t cols;
+    uint64_t dataOffset; // where the elevations start
+};
+
+// Size of the elevations of a binary map (all the tiles, padded)
+size_t binaryMapDataBytes(int rows, int cols) {
+    size_t tileRows = (rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    size_t tileCols = (cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    return tileRows * tileCols * MAP_TILE_SIZE * MAP_TILE_SIZE * sizeof(float);
+}
+
+// Read and check the header of a binary map
+bool readHeader(int fd, BinaryMapHeader& header) {
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        return false;
+    }
+    return memcmp(header.magic, BINARY_MAP_MAGIC, sizeof(header.magic)) == 0 && header.version == BINARY_MAP_VERSION &&
+           header.tileSize == MAP_TILE_SIZE && header.rows > 0 && header.cols > 0;
+}
+
+// Read the next number of a text map (getc-based, so the map is streamed)
+bool readNumber(FILE* file, char* token, size_t capacity) {
+    int c;
+    while ((c = getc_unlocked(file)) != EOF && (c == ' ' || c == '\t' || c == '\n' || c == '\r')) {
+    }
+    size_t length = 0;
+    while (c != EOF && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        if (length + 1 < capacity) {
+            token[length++] = (char)c;
+        }
+        c = getc_unlocked(file);
+    }
+    token[length] = '\0';
+    return length > 0;
+}
+
+// A new binary map file, mapped for writing
+struct BinaryMapFile {
+    int fd = -1;
+    void* mapping = MAP_FAILED;
+    size_t fileBytes = 0;
+    float* cells = nullptr;
+};
+
+// Create the file of a binary map of the given size, and map it. The tiles are
+// written through the shared mapping, and written back by the kernel as it
+// needs the memory.
+bool createMapFile(const std::string& binaryMapPath, int rows, int cols, BinaryMapFile& file) {
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    file.fileBytes = pageSize + binaryMapDataBytes(rows, cols);
+    file.fd = open(binaryMapPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file.fd == -1) {
+        return false;
+    }
+    if (ftruncate(file.fd, file.fileBytes) == 0) {
+        file.mapping = mmap(nullptr, file.fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+    }
+    if (file.mapping == MAP_FAILED) {
+        close(file.fd);
+        unlink(binaryMapPath.c_str());
+        return false;
+    }
+    file.cells = reinterpret_cast<float*>(static_cast<char*>(file.mapping) + pageSize);
+    return true;
+}
+
+// Write the header of a complete map, and flush the file. The header goes in
+// last, so that an interrupted map is left invalid (and is removed).
+bool finishMapFile(const std::string& binaryMapPath, int rows, int cols, bool complete, BinaryMapFile& file) {
+    if (complete) {
+        BinaryMapHeader header = {};
+        memcpy(header.magic, BINARY_MAP_MAGIC, sizeof(header.magic));
+        header.version = BINARY_MAP_VERSION;
+        header.tileSize = MAP_TILE_SIZE;
+        header.rows = rows;
+        header.cols = cols;
+        header.dataOffset = file.fileBytes - binaryMapDataBytes(rows, cols);
+        memcpy(file.mapping, &header, sizeof(header));
+    }
+    bool written = msync(file.mapping, file.fileBytes, MS_SYNC) == 0;
+    munmap(file.mapping, file.fileBytes);
+    close(file.fd);
+    if (!complete || !written) {
+        unlink(binaryMapPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool isBinaryMap(const std::string& mapFilePath) {
+    const std::string extension = ".bmap";
+    return mapFilePath.size() > extension.size() &&
+           mapFilePath.compare(mapFilePath.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool convertMap(const std::string& textMapPath, const std::string& binaryMapPath) {
+    FILE* text = fopen(textMapPath.c_str(), "r");
+    if (text == nullptr) {
+        return false;
+    }
+    char token[64];
+    int rows = 0, cols = 0;
+    if (readNumber(text, token, sizeof(token))) rows = atoi(token);
+    if (readNumber(text, token, sizeof(token))) cols = atoi(token);
+    if (rows <= 0 || cols <= 0) {
+        fclose(text);
+        return false;
+    }
+
+    BinaryMapFile file;
+    if (!createMapFile(binaryMapPath, rows, cols, file)) {
+        fclose(text);
+        return false;
+    }
+    madvise(file.mapping, file.fileBytes, MADV_SEQUENTIAL);
+
+    const int tileCols = (cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    const std::vector<size_t> tileOffsets = mortonTileOffsets((rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT, tileCols);
+    float* cells = file.cells;
+    bool complete = true;
+    for (int row = 0; row < rows && complete; row++) {
+        for (int col = 0; col < cols; col++) {
+            if (!readNumber(text, token, sizeof(token))) {
+                complete = false; // truncated map
+                break;
+            }
+            size_t tile = (size_t)(row >> MAP_TILE_SHIFT) * tileCols + (col >> MAP_TILE_SHIFT);
+            cells[tileOffsets[tile] + ((row & MAP_TILE_MASK) << MAP_TILE_SHIFT | (col & MAP_TILE_MASK))] = strtof(token, nullptr);
+        }
+    }
+    fclose(text);
+    return finishMapFile(binaryMapPath, rows, cols, complete, file);
+}
+
+bool createBinaryMap(const std::string& binaryMapPath, int rows, int cols,
+                     const std::function<void(int, int, int, float*)>& fillRow) {
+    if (rows <= 0 || cols <= 0) {
+        return false;
+    }
+    BinaryMapFile file;
+    if (!createMapFile(binaryMapPath, rows, cols, file)) {
+        return false;
+    }
+
+    // The workers take the tiles in the order they are stored in, so the file
+    // is written roughly from start to end
+    const int tileRows = (rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    const int tileCols = (cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    const std::vector<size_t> tileOffsets = mortonTileOffsets(tileRows, tileCols);
+    const size_t numTiles = tileOffsets.size();
+    std::vector<size_t> order(numTiles);
+    for (size_t tile = 0; tile < numTiles; tile++) {
+        order[tileOffsets[tile] / (MAP_TILE_SIZE * MAP_TILE_SIZE)] = tile;
+    }
+    std::atomic<size_t> nextRank{0};
+    std::vector<std::thread> workers;
+    size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t w = 0; w < numWorkers; w++) {
+        workers.emplace_back([&]() {
+            size_t rank;
+            while ((rank = nextRank.fetch_add(1)) < numTiles) {
+                size_t tile = order[rank];
+                int firstRow = (int)(tile / tileCols) << MAP_TILE_SHIFT;
+                int firstCol = (int)(tile % tileCols) << MAP_TILE_SHIFT;
+                int count = std::min(MAP_TILE_SIZE, cols - firstCol);
+                float* cells = file.cells + tileOffsets[tile];
+                for (int i = 0; i < MAP_TILE_SIZE && firstRow + i < rows; i++) {
+                    fillRow(firstRow + i, firstCol, count, cells + (i << MAP_TILE_SHIFT));
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return finishMapFile(binaryMapPath, rows, cols, true, file);
+}
+
+bool openBinaryMap(const std::string& mapFilePath, ElevationMap& map) {
+    int fd = open(mapFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    BinaryMapHeader header;
+    struct stat fileStat;
+    if (!readHeader(fd, header) || fstat(fd, &fileStat) == -1 ||
+        (size_t)fileStat.st_size < header.dataOffset + binaryMapDataBytes(header.rows, header.cols)) {
+        close(fd);
+        return false;
+    }
+    const size_t fileBytes = header.dataOffset + binaryMapDataBytes(header.rows, header.cols);
+    void* mapping = mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    // Skiers jump from tile to tile: no read-ahead beyond what they ask for
+    madvise(mapping, fileBytes, MADV_RANDOM);
+
+    map.rows = header.rows;
+    map.cols = header.cols;
+    map.storage.clear();
+    map.storage.shrink_to_fit();
+    map.cells = reinterpret_cast<const float*>(static_cast<const char*>(mapping) + header.dataOffset);
+    map.backing = std::shared_ptr<const void>(mapping, [fileBytes](const void* address) {
+        munmap(const_cast<void*>(address), fileBytes);
+    });
+    map.tileCols = (header.cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    map.tileOffsets = mortonTileOffsets((header.rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT, map.tileCols);
+    return true;
+}
+
+bool readBinaryMapSize(const std::string& mapFilePath, int& rows, int& cols) {
+    int fd = open(mapFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    BinaryMapHeader header;
+    bool valid = readHeader(fd, header);
+    close(fd);
+    if (valid) {
+        rows = header.rows;
+        cols = header.cols;
+    }
+    return valid;
+}
+
+void willNeedTile(const ElevationMap& map, int tileRow, int tileCol) {
+    if (map.tileOffsets.empty() || tileRow < 0 || tileCol < 0 || tileRow > (map.rows - 1) >> MAP_TILE_SHIFT ||
+        tileCol >= map.tileCols) {
+        return;
+    }
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(map.cells + map.tileOffsets[(size_t)tileRow * map.tileCols + tileCol]);
+    uintptr_t end = begin + MAP_TILE_SIZE * MAP_TILE_SIZE * sizeof(float);
+    begin &= ~(pageSize - 1);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
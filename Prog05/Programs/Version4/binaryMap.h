@@ -0,0 +1,40 @@
+#ifndef BINARY_MAP_H
+#define BINARY_MAP_H
+
+#include <functional>
+#include <string>
+
+#include "elevationMap.h"
+
+// Binary maps (.bmap), for maps too large to be read into memory.
+//
+// A binary map starts with a one page header, followed by the elevations in
+// tiles of MAP_TILE_SIZE x MAP_TILE_SIZE, in Morton order (the layout of
+// tileMap). It is mapped read-only rather than read: only the tiles the skiers
+// go through are paged in, and the kernel can drop them again when memory runs
+// short, so a map can be larger than the physical memory.
+
+// Checks if a map file is a binary map (by its extension)
+bool isBinaryMap(const std::string& mapFilePath);
+
+// Convert a text map to a binary map. The text map is streamed, never held in
+// memory as a whole. Returns false if either file cannot be used.
+bool convertMap(const std::string& textMapPath, const std::string& binaryMapPath);
+
+// Create a binary map from a function of the elevations: fillRow(row, col,
+// count, elevations) gives the `count` elevations of a row from column `col`
+// on. It is called a tile at a time, from several threads at once (so it must
+// be thread-safe), and the map is never held in memory as a whole.
+bool createBinaryMap(const std::string& binaryMapPath, int rows, int cols,
+                     const std::function<void(int, int, int, float*)>& fillRow);
+
+// Map a binary map (read-only). Returns false if it is not a valid binary map.
+bool openBinaryMap(const std::string& mapFilePath, ElevationMap& map);
+
+// Read only the dimensions of a binary map
+bool readBinaryMapSize(const std::string& mapFilePath, int& rows, int& cols);
+
+// Tell the kernel that a tile of a mapped map is about to be read
+void willNeedTile(const ElevationMap& map, int tileRow, int tileCol);
+
+#endif // BINARY_MAP_H
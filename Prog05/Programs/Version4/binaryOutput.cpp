@@ -0,0 +1,187 @@
+#include "binaryOutput.h"
+#include "descentIndex.h"
+#include "resultWriter.h"
+
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Text output written out whenever it gets this large
+const size_t TEXT_FLUSH_SIZE = 1 << 20;
+
+// Direction code of a move, indexed by (rowStep + 1) * 3 + (colStep + 1)
+const uint8_t MOVE_DIRECTION[9] = {0, 1, 2, 3, LOCAL_MINIMUM, 4, 5, 6, 7};
+
+bool isBinaryOutput(const std::string& outputFilePath) {
+    const std::string extension = ".bout";
+    return outputFilePath.size() > extension.size() &&
+           outputFilePath.compare(outputFilePath.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void appendBinaryOutputHeader(std::string& output, bool traceMode, uint64_t skiers) {
+    BinaryOutputHeader header{};
+    memcpy(header.magic, BINARY_OUTPUT_MAGIC, sizeof(header.magic));
+    header.version = BINARY_OUTPUT_VERSION;
+    header.traceMode = traceMode ? 1 : 0;
+    header.skiers = skiers;
+    output.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void MovePacker::add(int rowStep, int colStep) {
+    bits |= (uint32_t)MOVE_DIRECTION[(rowStep + 1) * 3 + colStep + 1] << numBits;
+    numBits += 3;
+    if (numBits >= 8) {
+        output += (char)(bits & 0xFF);
+        bits >>= 8;
+        numBits -= 8;
+    }
+}
+
+void MovePacker::finish() {
+    if (numBits > 0) {
+        output += (char)bits;
+    }
+    bits = 0;
+    numBits = 0;
+}
+
+bool BinaryOutputReader::open(const std::string& outputFilePath) {
+    int fd = ::open(outputFilePath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) == -1 || (size_t)fileStat.st_size < sizeof(BinaryOutputHeader)) {
+        close(fd);
+        return false;
+    }
+    const size_t fileBytes = fileStat.st_size;
+    void* address = mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+    // The records are read once, front to back
+    madvise(address, fileBytes, MADV_SEQUENTIAL);
+    mapping = std::shared_ptr<const void>(address, [fileBytes](const void* address) {
+        munmap(const_cast<void*>(address), fileBytes);
+    });
+    data = static_cast<const unsigned char*>(address);
+    size = fileBytes;
+    memcpy(&fileHeader, data, sizeof(fileHeader));
+    position = sizeof(fileHeader);
+    skiersRead = 0;
+    return memcmp(fileHeader.magic, BINARY_OUTPUT_MAGIC, sizeof(fileHeader.magic)) == 0 &&
+           fileHeader.version == BINARY_OUTPUT_VERSION;
+}
+
+bool BinaryOutputReader::next(BinarySkierRecord& record, std::vector<std::pair<int, int>>* path) {
+    if (skiersRead == fileHeader.skiers || size - position < sizeof(record)) {
+        return false;
+    }
+    memcpy(&record, data + position, sizeof(record));
+    position += sizeof(record);
+    skiersRead++;
+    if (!fileHeader.traceMode || record.length == 0) {
+        return true;
+    }
+
+    const size_t numMoves = record.length - 1;
+    const size_t moveBytes = (numMoves * 3 + 7) / 8;
+    if (size - position < moveBytes) {
+        return false;
+    }
+    if (path != nullptr) {
+        path->clear();
+        path->reserve(record.length);
+        int row = record.startRow, col = record.startCol;
+        path->push_back({row, col});
+        const unsigned char* moves = data + position;
+        for (size_t move = 0; move < numMoves; move++) {
+            // A move may straddle two bytes
+            size_t bit = move * 3;
+            unsigned direction = moves[bit / 8] >> (bit % 8);
+            if (bit % 8 > 5) {
+                direction |= moves[bit / 8 + 1] << (8 - bit % 8);
+            }
+            direction &= 7;
+            row += DESCENT_ROW_STEP[direction];
+            col += DESCENT_COL_STEP[direction];
+            path->push_back({row, col});
+        }
+    }
+    position += moveBytes;
+    return true;
+}
+
+// Append a number in decimal
+static void appendNumber(std::string& output, int64_t value) {
+    char digits[24];
+    auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+    output.append(digits, end);
+}
+
+// Write out (and empty) a buffer of text output
+static bool flushText(int fd, std::string& text) {
+    std::vector<struct iovec> buffers = {{text.data(), text.size()}};
+    bool written = writeBuffers(fd, buffers);
+    text.clear();
+    return written;
+}
+
+bool convertBinaryOutput(const std::string& binaryOutputPath, const std::string& textOutputPath) {
+    BinaryOutputReader reader;
+    if (!reader.open(binaryOutputPath)) {
+        return false;
+    }
+    int fd = open(textOutputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+
+    // The same lines, in the same order, as runTask writes for the task
+    const bool traceMode = reader.header().traceMode != 0;
+    std::string text = std::string(traceMode ? "TRACE" : "NO_TRACE") + "\n" + std::to_string(reader.header().skiers) + "\n";
+    bool written = true;
+    BinarySkierRecord record;
+    std::vector<std::pair<int, int>> path;
+    uint64_t skiers = 0;
+    while (written && reader.next(record, traceMode ? &path : nullptr)) {
+        skiers++;
+        if (record.length == 0) {
+            text += "Start point at row=";
+            appendNumber(text, (int64_t)record.startRow + 1);
+            text += ", column=";
+            appendNumber(text, (int64_t)record.startCol + 1);
+            text += " is invalid.\n";
+        } else {
+            appendNumber(text, (int64_t)record.startRow + 1);
+            text += ' ';
+            appendNumber(text, (int64_t)record.startCol + 1);
+            text += ' ';
+            appendNumber(text, (int64_t)record.endRow + 1);
+            text += ' ';
+            appendNumber(text, (int64_t)record.endCol + 1);
+            text += ' ';
+            appendNumber(text, record.length);
+            text += '\n';
+            if (traceMode) {
+                for (const auto& [row, col] : path) {
+                    appendNumber(text, (int64_t)row + 1);
+                    text += ' ';
+                    appendNumber(text, (int64_t)col + 1);
+                    text += ' ';
+                }
+                text += '\n';
+            }
+        }
+        if (text.size() >= TEXT_FLUSH_SIZE) {
+            written = flushText(fd, text);
+        }
+    }
+    written = written && flushText(fd, text) && skiers == reader.header().skiers;
+    return close(fd) == 0 && written;
+}
@@ -0,0 +1,88 @@
+#ifndef BINARY_OUTPUT_H
+#define BINARY_OUTPUT_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary output files (.bout), for tasks with many skiers or long paths.
+//
+// The text output of a TRACE task spells out every point of every path
+// ("row col ", about ten bytes a point). The binary output starts with a
+// BinaryOutputHeader, followed by one record per skier, in start-point order:
+//  - a BinarySkierRecord: the start and the end of the path (0-based) and its
+//    number of points (0 for an invalid start point, whose end is its start);
+//  - TRACE only: the moves of the path, 3 bits each (the direction of the
+//    move, as in DESCENT_ROW_STEP and DESCENT_COL_STEP), packed from the low
+//    bits of the first byte on, the last byte padded with zeros.
+// Integers are in the byte order of the machine, as in binary maps.
+
+const char BINARY_OUTPUT_MAGIC[8] = "P05BOUT";
+const uint32_t BINARY_OUTPUT_VERSION = 1;
+
+struct BinaryOutputHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t traceMode; // 1 if the records are followed by their paths
+    uint64_t skiers;
+};
+
+struct BinarySkierRecord {
+    int32_t startRow;
+    int32_t startCol;
+    int32_t endRow;
+    int32_t endCol;
+    uint32_t length; // points on the path, both ends included
+};
+
+// Checks if an output file is a binary output file (by its extension)
+bool isBinaryOutput(const std::string& outputFilePath);
+
+// Append the header of a binary output file to a buffer
+void appendBinaryOutputHeader(std::string& output, bool traceMode, uint64_t skiers);
+
+// Packs the moves of a path into a buffer, 3 bits each
+class MovePacker {
+public:
+    explicit MovePacker(std::string& output) : output(output) {}
+
+    // Add a move, from a cell to one of its neighbors
+    void add(int rowStep, int colStep);
+
+    // Write out the last byte, if it is not full
+    void finish();
+
+private:
+    std::string& output;
+    uint32_t bits = 0;
+    int numBits = 0;
+};
+
+// A binary output file, mapped read-only and read a record at a time
+class BinaryOutputReader {
+public:
+    // Map a binary output file. Returns false if it is not a valid one.
+    bool open(const std::string& outputFilePath);
+
+    const BinaryOutputHeader& header() const { return fileHeader; }
+
+    // Read the next skier, and its path if the file has them (and `path` is
+    // given). Returns false after the last skier, or on a truncated record.
+    bool next(BinarySkierRecord& record, std::vector<std::pair<int, int>>* path = nullptr);
+
+private:
+    std::shared_ptr<const void> mapping;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    size_t position = 0;
+    uint64_t skiersRead = 0;
+    BinaryOutputHeader fileHeader{};
+};
+
+// Write a binary output file as the text output of the same task, byte for
+// byte. Returns false if either file cannot be used.
+bool convertBinaryOutput(const std::string& binaryOutputPath, const std::string& textOutputPath);
+
+#endif // BINARY_OUTPUT_H
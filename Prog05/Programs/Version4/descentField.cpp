@@ -0,0 +1,235 @@
+#include "descentField.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "binaryMap.h"
+
+namespace {
+
+const char DESCENT_FIELD_MAGIC[8] = "P05FELD";
+const uint32_t DESCENT_FIELD_VERSION = 1;
+const int TILE_CELLS = MAP_TILE_SIZE * MAP_TILE_SIZE;
+
+// Header of a descent field file. The directions start on the next page.
+struct DescentFieldHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tileSize;
+    int32_t rows;
+    int32_t cols;
+    // The map file the field was computed from
+    int64_t mapSize;
+    int64_t mapMtime;
+    uint64_t dataOffset;
+};
+
+size_t fieldDataBytes(const ElevationMap& map) {
+    return map.tileOffsets.size() * TILE_CELLS;
+}
+
+// Directions of the cells of one tile. The tile's elevations and a one cell
+// ring of its neighbors' (the halo) are first copied into a local block, so
+// that the tile is computed without going back to the map.
+void computeTile(const ElevationMap& map, int tileRow, int tileCol, uint8_t* direction) {
+    const int HALO_SIZE = MAP_TILE_SIZE + 2;
+    float halo[HALO_SIZE][HALO_SIZE];
+    const int firstRow = tileRow * MAP_TILE_SIZE - 1;
+    const int firstCol = tileCol * MAP_TILE_SIZE - 1;
+    for (int i = 0; i < HALO_SIZE; i++) {
+        for (int j = 0; j < HALO_SIZE; j++) {
+            // Off the map, a neighbor is never lower (as if it wasn't there)
+            halo[i][j] = map.contains(firstRow + i, firstCol + j) ? map.at(firstRow + i, firstCol + j) : INFINITY;
+        }
+    }
+
+    for (int i = 0; i < MAP_TILE_SIZE; i++) {
+        for (int j = 0; j < MAP_TILE_SIZE; j++) {
+            uint8_t best = LOCAL_MINIMUM;
+            if (map.contains(firstRow + 1 + i, firstCol + 1 + j)) {
+                // Same neighbor order and strict comparison as descentDirection
+                float lowestElevation = halo[i + 1][j + 1];
+                for (uint8_t d = 0; d < 8; d++) {
+                    float elevation = halo[i + 1 + DESCENT_ROW_STEP[d]][j + 1 + DESCENT_COL_STEP[d]];
+                    if (elevation < lowestElevation) {
+                        lowestElevation = elevation;
+                        best = d;
+                    }
+                }
+            }
+            direction[i << MAP_TILE_SHIFT | j] = best;
+        }
+    }
+}
+
+// Compute the whole field, the tiles in the order they are stored in
+void computeField(const ElevationMap& map, uint8_t* direction) {
+    const size_t numTiles = map.tileOffsets.size();
+    std::vector<size_t> order(numTiles);
+    for (size_t tile = 0; tile < numTiles; tile++) {
+        order[map.tileOffsets[tile] / TILE_CELLS] = tile;
+    }
+
+    size_t numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    std::atomic<size_t> nextRank{0};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers; w++) {
+        workers.emplace_back([&map, &order, &nextRank, direction, numTiles, numWorkers]() {
+            size_t rank;
+            while ((rank = nextRank.fetch_add(1)) < numTiles) {
+                // Ask for the tile this worker will most likely take next
+                if (rank + numWorkers < numTiles) {
+                    size_t ahead = order[rank + numWorkers];
+                    willNeedTile(map, ahead / map.tileCols, ahead % map.tileCols);
+                }
+                size_t tile = order[rank];
+                computeTile(map, tile / map.tileCols, tile % map.tileCols, direction + rank * TILE_CELLS);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Map an existing field file, if it was computed from this version of the map
+bool openField(const std::string& fieldPath, const ElevationMap& map, const struct stat& mapStat, DescentField& field) {
+    int fd = open(fieldPath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    DescentFieldHeader header;
+    struct stat fieldStat;
+    bool valid = pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) && fstat(fd, &fieldStat) == 0 &&
+                 memcmp(header.magic, DESCENT_FIELD_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == DESCENT_FIELD_VERSION && header.tileSize == MAP_TILE_SIZE &&
+                 header.rows == map.rows && header.cols == map.cols && header.mapSize == mapStat.st_size &&
+                 header.mapMtime == mapStat.st_mtime &&
+                 (size_t)fieldStat.st_size >= header.dataOffset + fieldDataBytes(map);
+    if (!valid) {
+        close(fd);
+        return false;
+    }
+    const size_t fileBytes = header.dataOffset + fieldDataBytes(map);
+    void* mapping = mmap(nullptr, fileBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    madvise(mapping, fileBytes, MADV_RANDOM);
+    field.direction = static_cast<const uint8_t*>(mapping) + header.dataOffset;
+    field.backing = std::shared_ptr<const void>(mapping, [fileBytes](const void* address) {
+        munmap(const_cast<void*>(address), fileBytes);
+    });
+    return true;
+}
+
+// Compute the field into a new field file
+bool writeField(const std::string& fieldPath, const ElevationMap& map, const struct stat& mapStat) {
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    const size_t fileBytes = pageSize + fieldDataBytes(map);
+    const std::string temporaryPath = fieldPath + ".tmp" + std::to_string(getpid());
+    int fd = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        return false;
+    }
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, fileBytes) == 0) {
+        mapping = mmap(nullptr, fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    computeField(map, static_cast<uint8_t*>(mapping) + pageSize);
+    DescentFieldHeader header = {};
+    memcpy(header.magic, DESCENT_FIELD_MAGIC, sizeof(header.magic));
+    header.version = DESCENT_FIELD_VERSION;
+    header.tileSize = MAP_TILE_SIZE;
+    header.rows = map.rows;
+    header.cols = map.cols;
+    header.mapSize = mapStat.st_size;
+    header.mapMtime = mapStat.st_mtime;
+    header.dataOffset = pageSize;
+    memcpy(mapping, &header, sizeof(header));
+    bool written = msync(mapping, fileBytes, MS_SYNC) == 0;
+    munmap(mapping, fileBytes);
+
+    // Another dispatcher may have computed the same field meanwhile: either copy will do
+    if (!written || rename(temporaryPath.c_str(), fieldPath.c_str()) == -1) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Hint that a tile of the field is about to be read
+void willNeedFieldTile(const DescentField& field, int tileRow, int tileCol) {
+    if (tileRow < 0 || tileCol < 0 || tileRow > (field.rows - 1) >> MAP_TILE_SHIFT || tileCol >= field.tileCols) {
+        return;
+    }
+    static const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(field.direction + field.tileOffsets[(size_t)tileRow * field.tileCols + tileCol]);
+    uintptr_t end = begin + TILE_CELLS;
+    begin &= ~(pageSize - 1);
+    madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+} // namespace
+
+int64_t DescentField::next(int64_t cell) const {
+    int row = (int)(cell / cols);
+    int col = (int)(cell % cols);
+    uint8_t d = at(row, col);
+    if (d == LOCAL_MINIMUM) {
+        return cell;
+    }
+    int nextRow = row + DESCENT_ROW_STEP[d];
+    int nextCol = col + DESCENT_COL_STEP[d];
+    // Entering a new tile: ask for the one after it, in the same direction
+    if ((nextRow >> MAP_TILE_SHIFT) != (row >> MAP_TILE_SHIFT) || (nextCol >> MAP_TILE_SHIFT) != (col >> MAP_TILE_SHIFT)) {
+        willNeedFieldTile(*this, (nextRow >> MAP_TILE_SHIFT) + DESCENT_ROW_STEP[d], (nextCol >> MAP_TILE_SHIFT) + DESCENT_COL_STEP[d]);
+    }
+    return (int64_t)nextRow * cols + nextCol;
+}
+
+bool loadDescentField(const ElevationMap& map, const std::string& mapFilePath, DescentField& field) {
+    struct stat mapStat;
+    if (map.tileOffsets.empty() || stat(mapFilePath.c_str(), &mapStat) == -1) {
+        return false;
+    }
+    field.rows = map.rows;
+    field.cols = map.cols;
+    field.tileCols = map.tileCols;
+    field.tileOffsets = map.tileOffsets;
+
+    const std::string fieldPath = mapFilePath + ".field";
+    if (openField(fieldPath, map, mapStat, field)) {
+        return true;
+    }
+    if (writeField(fieldPath, map, mapStat) && openField(fieldPath, map, mapStat, field)) {
+        return true;
+    }
+
+    // No room for the field file: keep it in memory, where the kernel can still swap it out
+    const size_t dataBytes = fieldDataBytes(map);
+    void* mapping = mmap(nullptr, dataBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    computeField(map, static_cast<uint8_t*>(mapping));
+    field.direction = static_cast<const uint8_t*>(mapping);
+    field.backing = std::shared_ptr<const void>(mapping, [dataBytes](const void* address) {
+        munmap(const_cast<void*>(address), dataBytes);
+    });
+    return true;
+}
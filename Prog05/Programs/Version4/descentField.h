@@ -0,0 +1,44 @@
+#ifndef DESCENT_FIELD_H
+#define DESCENT_FIELD_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "elevationMap.h"
+#include "descentIndex.h"
+
+// Descent field of a binary map, for maps too large for a descent index.
+//
+// For every cell, the direction a skier leaves it in (one byte, as in the
+// descent index), stored in the tiles of the map and kept in a file next to it
+// (<map>.field), so that it is computed once and then paged in and out like
+// the map itself. A skier follows the field and never reads the elevations.
+struct DescentField {
+    int rows = 0;
+    int cols = 0;
+    int tileCols = 0;
+    std::vector<size_t> tileOffsets; // same tiles as the map
+    const uint8_t* direction = nullptr;
+    std::shared_ptr<const void> backing;
+
+    // Direction a skier leaves a (0-based) cell in
+    uint8_t at(int row, int col) const {
+        return direction[tileOffsets[(size_t)(row >> MAP_TILE_SHIFT) * tileCols + (col >> MAP_TILE_SHIFT)] +
+                         ((row & MAP_TILE_MASK) << MAP_TILE_SHIFT | (col & MAP_TILE_MASK))];
+    }
+
+    // Cell a skier moves to from a given cell (itself for a local minimum).
+    // Cells are numbered row-major, on 64 bits since these maps can be huge.
+    int64_t next(int64_t cell) const;
+};
+
+// Open the descent field of a (tiled) binary map, computing it first if its
+// file is missing or older than the map. The field is computed a tile at a
+// time, each tile with a one cell halo of elevations from its neighbors, so
+// that only a few tiles of the map are needed in memory at once. Falls back to
+// a field in (swappable) anonymous memory if the file cannot be written.
+bool loadDescentField(const ElevationMap& map, const std::string& mapFilePath, DescentField& field);
+
+#endif // DESCENT_FIELD_H
@@ -0,0 +1,174 @@
+#include "descentIndex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+
+size_t descentIndexBytes(int rows, int cols) {
+    return (size_t)rows * cols * (sizeof(uint8_t) + 2 * sizeof(int32_t));
+}
+
+// Same neighbor order and strict comparison as steepestDescent
+template <typename ElevationAt>
+static uint8_t lowestNeighbor(const ElevationMap& map, int row, int col, ElevationAt elevationAt) {
+    auto lowestElevation = elevationAt(row, col);
+    uint8_t best = LOCAL_MINIMUM;
+    for (uint8_t d = 0; d < 8; d++) {
+        int r = row + DESCENT_ROW_STEP[d];
+        int c = col + DESCENT_COL_STEP[d];
+        if (!map.contains(r, c)) continue;
+        if (elevationAt(r, c) < lowestElevation) {
+            lowestElevation = elevationAt(r, c);
+            best = d;
+        }
+    }
+    return best;
+}
+
+uint8_t descentDirection(const ElevationMap& map, int row, int col) {
+    // Fixed-point elevations compare as the floats they stand for
+    if (map.compact()) {
+        return lowestNeighbor(map, row, col, [&map](int r, int c) { return map.compactAt(r, c); });
+    }
+    return lowestNeighbor(map, row, col, [&map](int r, int c) { return map.cells[map.offset(r, c)]; });
+}
+
+// Fill in the basin of a cell, and of the cells on its path down to the first one whose basin is known.
+// Workers filling basins at the same time may fill the same cells: they write
+// the same values, the length of a cell before its basin, so that a cell seen
+// with a basin also has its length.
+static void fillBasin(DescentIndex& index, int32_t start, std::vector<int32_t>& trail) {
+    auto basin = [&index](int32_t cell) { return std::atomic_ref<int32_t>(index.basin[cell]); };
+    auto pathLength = [&index](int32_t cell) { return std::atomic_ref<int32_t>(index.pathLength[cell]); };
+    int32_t cell = start;
+    while (basin(cell).load(std::memory_order_acquire) == -1 && index.direction[cell] != LOCAL_MINIMUM) {
+        trail.push_back(cell);
+        cell = index.next(cell);
+    }
+    if (basin(cell).load(std::memory_order_acquire) == -1) { // a local minimum seen for the first time
+        pathLength(cell).store(1, std::memory_order_relaxed);
+        basin(cell).store(cell, std::memory_order_release);
+    }
+    const int32_t bottom = basin(cell).load(std::memory_order_relaxed);
+    int32_t length = pathLength(cell).load(std::memory_order_relaxed);
+    while (!trail.empty()) {
+        int32_t previous = trail.back();
+        trail.pop_back();
+        pathLength(previous).store(++length, std::memory_order_relaxed);
+        basin(previous).store(bottom, std::memory_order_release);
+    }
+}
+
+// Run work(first, end) over ranges of cells, on all the processors
+static void forEachCellRange(size_t numCells, const std::function<void(size_t, size_t)>& work) {
+    const size_t CELLS_PER_RANGE = 1 << 16;
+    const size_t numRanges = (numCells + CELLS_PER_RANGE - 1) / CELLS_PER_RANGE;
+    const size_t numWorkers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), numRanges);
+    std::atomic<size_t> nextRange{0};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers; w++) {
+        workers.emplace_back([&work, &nextRange, numRanges, numCells, CELLS_PER_RANGE]() {
+            size_t range;
+            while ((range = nextRange.fetch_add(1)) < numRanges) {
+                work(range * CELLS_PER_RANGE, std::min(numCells, (range + 1) * CELLS_PER_RANGE));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Build the descent field and the basins of a map
+void buildDescentIndex(const ElevationMap& map, DescentIndex& index) {
+    const int rows = map.rows;
+    const int cols = map.cols;
+    const size_t numCells = (size_t)rows * cols;
+    index.rows = rows;
+    index.cols = cols;
+    index.direction.assign(numCells, LOCAL_MINIMUM);
+    index.basin.assign(numCells, -1);
+    index.pathLength.assign(numCells, 0);
+
+    // Descent field, then basins: from each cell, follow the field until we
+    // reach a cell whose basin is already known (or a local minimum), then fill
+    // in the cells we went through. Both are computed in parallel.
+    forEachCellRange(numCells, [&map, &index, cols](size_t first, size_t end) {
+        int row = (int)(first / cols);
+        int col = (int)(first % cols);
+        for (size_t cell = first; cell < end; cell++) {
+            index.direction[cell] = descentDirection(map, row, col);
+            if (++col == cols) {
+                col = 0;
+                row++;
+            }
+        }
+    });
+    forEachCellRange(numCells, [&index](size_t first, size_t end) {
+        std::vector<int32_t> trail;
+        for (size_t start = first; start < end; start++) {
+            fillBasin(index, (int32_t)start, trail);
+        }
+    });
+}
+
+size_t updateDescentIndex(const ElevationMap& map, DescentIndex& index, int row, int col, int rows, int cols) {
+    // The direction of a cell depends on its neighbors: the rectangle and a
+    // one cell ring around it are recomputed
+    std::vector<int32_t> changed;
+    for (int r = std::max(0, row - 1); r <= std::min(map.rows - 1, row + rows); r++) {
+        for (int c = std::max(0, col - 1); c <= std::min(map.cols - 1, col + cols); c++) {
+            int32_t cell = r * index.cols + c;
+            uint8_t direction = descentDirection(map, r, c);
+            if (direction != index.direction[cell]) {
+                index.direction[cell] = direction;
+                changed.push_back(cell);
+            }
+        }
+    }
+
+    // Only the cells whose path goes through a changed direction can end
+    // somewhere else: find them going uphill from the changed cells (against
+    // the new field), and forget their basins
+    std::vector<int32_t> affected;
+    for (int32_t cell : changed) {
+        index.basin[cell] = -1;
+        affected.push_back(cell);
+    }
+    for (size_t k = 0; k < affected.size(); k++) {
+        int32_t cell = affected[k];
+        int r = cell / index.cols;
+        int c = cell % index.cols;
+        for (uint8_t d = 0; d < 8; d++) {
+            int uphillRow = r + DESCENT_ROW_STEP[d];
+            int uphillCol = c + DESCENT_COL_STEP[d];
+            if (!map.contains(uphillRow, uphillCol)) continue;
+            int32_t uphill = uphillRow * index.cols + uphillCol;
+            if (index.basin[uphill] != -1 && index.next(uphill) == cell) {
+                index.basin[uphill] = -1;
+                affected.push_back(uphill);
+            }
+        }
+    }
+
+    // Then fill them in again, as buildDescentIndex does
+    std::vector<int32_t> trail;
+    for (int32_t cell : affected) {
+        fillBasin(index, cell, trail);
+    }
+    return affected.size();
+}
+
+// Path of a skier, read off the descent field (same result as steepestDescent)
+std::vector<std::pair<int, int>> indexedDescent(const DescentIndex& index, int startRow, int startCol) {
+    int32_t cell = startRow * index.cols + startCol;
+    std::vector<std::pair<int, int>> path;
+    path.reserve(index.pathLength[cell]);
+    path.push_back({startRow, startCol});
+    while (index.direction[cell] != LOCAL_MINIMUM) {
+        cell = index.next(cell);
+        path.push_back({cell / index.cols, cell % index.cols});
+    }
+    return path;
+}
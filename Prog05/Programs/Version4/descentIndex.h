@@ -0,0 +1,56 @@
+#ifndef DESCENT_INDEX_H
+#define DESCENT_INDEX_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#include "elevationMap.h"
+
+// Neighbor directions, in the order steepestDescent looks at them (ties go to
+// the first one), followed by the "no lower neighbor" code of local minima.
+const int DESCENT_ROW_STEP[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+const int DESCENT_COL_STEP[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+const uint8_t LOCAL_MINIMUM = 8;
+
+// Indexes derived from an elevation map, so that a skier's run is a lookup
+// instead of a search:
+//  - the descent field gives, for each cell, the direction of the neighbor a
+//    skier moves to from there (or LOCAL_MINIMUM);
+//  - the basins give, for each cell, the local minimum a skier dropped there
+//    ends at, and the number of points on its path.
+// Cells are numbered row-major (row * cols + col).
+struct DescentIndex {
+    int rows = 0;
+    int cols = 0;
+    PlacedVector<uint8_t> direction;  // descent field
+    PlacedVector<int32_t> basin;      // cell of the local minimum reached
+    PlacedVector<int32_t> pathLength; // points on the path, both ends included
+
+    // Cell a skier moves to from a given cell (itself for a local minimum)
+    int32_t next(int32_t cell) const {
+        uint8_t d = direction[cell];
+        return (d == LOCAL_MINIMUM) ? cell : cell + DESCENT_ROW_STEP[d] * cols + DESCENT_COL_STEP[d];
+    }
+
+    // Memory held by the index
+    size_t bytes() const {
+        return direction.capacity() + (basin.capacity() + pathLength.capacity()) * sizeof(int32_t);
+    }
+};
+
+// Direction a skier moves in from a cell (or LOCAL_MINIMUM)
+uint8_t descentDirection(const ElevationMap& map, int row, int col);
+// Memory an index over a rows x cols map will take
+size_t descentIndexBytes(int rows, int cols);
+// Build the descent field and the basins of a map
+void buildDescentIndex(const ElevationMap& map, DescentIndex& index);
+// Bring an index up to date after the elevations of a rectangle of the map
+// changed. Only the directions around the rectangle are recomputed, and only
+// the basins of the cells whose path goes through a changed direction.
+// Returns the number of cells whose basin was recomputed.
+size_t updateDescentIndex(const ElevationMap& map, DescentIndex& index, int row, int col, int rows, int cols);
+// Path of a skier, read off the descent field (same result as steepestDescent)
+std::vector<std::pair<int, int>> indexedDescent(const DescentIndex& index, int startRow, int startCol);
+
+#endif // DESCENT_INDEX_H
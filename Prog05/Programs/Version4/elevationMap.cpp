@@ -0,0 +1,275 @@
+#include "elevationMap.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// Read in the map file ("rows cols" header followed by the elevations)
+bool readMap(const std::string& filePath, ElevationMap& map) {
+
+    // The map is read in one go and parsed in place, instead of going
+    // through a stringstream per line: this is the dominant cost of a task
+    // on a small map, and the dispatcher only pays it once per map.
+    FILE* inFile = fopen(filePath.c_str(), "rb");
+
+    // if file cant be opened return false
+    if (inFile == nullptr) {
+        return false;
+    }
+
+    std::string text;
+    char chunk[1 << 16];
+    size_t bytes_read;
+    while ((bytes_read = fread(chunk, 1, sizeof(chunk), inFile)) > 0) {
+        text.append(chunk, bytes_read);
+    }
+    fclose(inFile);
+
+    // Read the dimensions of the map
+    const char* cursor = text.c_str();
+    char* next;
+    long rows = strtol(cursor, &next, 10);
+    cursor = next;
+    long cols = strtol(cursor, &next, 10);
+    cursor = next;
+    if (rows <= 0 || cols <= 0) {
+        return false;
+    }
+
+    map.rows = (int)rows;
+    map.cols = (int)cols;
+    map.backing.reset();
+    map.tileOffsets.clear();
+    map.compactStorage.clear();
+    map.storage.assign((size_t)rows * cols, 0.f);
+    map.cells = map.storage.data();
+
+    // Read the map data
+    for (size_t k = 0; k < map.storage.size(); k++) {
+        map.storage[k] = strtof(cursor, &next);
+        if (next == cursor) {
+            return false; // truncated map
+        }
+        cursor = next;
+    }
+
+    // if properly completed return true
+    return true;
+}
+
+// Read only the dimensions of a map file
+bool readMapSize(const std::string& filePath, int& rows, int& cols) {
+    FILE* inFile = fopen(filePath.c_str(), "r");
+    if (inFile == nullptr) {
+        return false;
+    }
+    bool found = fscanf(inFile, "%d %d", &rows, &cols) == 2 && rows > 0 && cols > 0;
+    fclose(inFile);
+    return found;
+}
+
+// Interleave the bits of a tile row and column (Morton code)
+static uint64_t mortonCode(uint32_t row, uint32_t col) {
+    uint64_t code = 0;
+    for (int bit = 0; bit < 32; bit++) {
+        code |= (uint64_t)((row >> bit) & 1) << (2 * bit + 1);
+        code |= (uint64_t)((col >> bit) & 1) << (2 * bit);
+    }
+    return code;
+}
+
+std::vector<size_t> mortonTileOffsets(int tileRows, int tileCols) {
+    // Only the tiles that exist are stored (the map need not be square, nor a
+    // power of two tiles across): each one goes at its rank in Morton order.
+    const size_t numTiles = (size_t)tileRows * tileCols;
+    std::vector<std::pair<uint64_t, size_t>> order(numTiles);
+    for (int tileRow = 0; tileRow < tileRows; tileRow++) {
+        for (int tileCol = 0; tileCol < tileCols; tileCol++) {
+            size_t tile = (size_t)tileRow * tileCols + tileCol;
+            order[tile] = {mortonCode(tileRow, tileCol), tile};
+        }
+    }
+    std::sort(order.begin(), order.end());
+    std::vector<size_t> tileOffsets(numTiles);
+    for (size_t rank = 0; rank < numTiles; rank++) {
+        tileOffsets[order[rank].second] = rank * MAP_TILE_SIZE * MAP_TILE_SIZE;
+    }
+    return tileOffsets;
+}
+
+size_t tiledMapBytes(int rows, int cols) {
+    size_t tileRows = (rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    size_t tileCols = (cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    return tileRows * tileCols * (MAP_TILE_SIZE * MAP_TILE_SIZE * sizeof(float) + sizeof(size_t));
+}
+
+void tileMap(ElevationMap& map) {
+    if (!map.tileOffsets.empty()) {
+        return;
+    }
+    const int tileRows = (map.rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    const int tileCols = (map.cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT;
+    const size_t numTiles = (size_t)tileRows * tileCols;
+
+    std::vector<size_t> tileOffsets = mortonTileOffsets(tileRows, tileCols);
+
+    PlacedVector<float> tiled(numTiles * MAP_TILE_SIZE * MAP_TILE_SIZE, 0.f);
+    for (int row = 0; row < map.rows; row++) {
+        for (int col = 0; col < map.cols; col++) {
+            size_t tile = (size_t)(row >> MAP_TILE_SHIFT) * tileCols + (col >> MAP_TILE_SHIFT);
+            tiled[tileOffsets[tile] + ((row & MAP_TILE_MASK) << MAP_TILE_SHIFT | (col & MAP_TILE_MASK))] = map.at(row, col);
+        }
+    }
+
+    map.storage = std::move(tiled);
+    map.cells = map.storage.data();
+    map.compactStorage.clear();
+    map.backing.reset();
+    map.tileOffsets = std::move(tileOffsets);
+    map.tileCols = tileCols;
+}
+
+bool compactMap(ElevationMap& map) {
+    if (map.compact()) {
+        return true;
+    }
+
+    // Every elevation must be exactly a number of hundredths, and all of them within 65536 hundredths
+    long lowest = LONG_MAX, highest = LONG_MIN;
+    for (int row = 0; row < map.rows; row++) {
+        for (int col = 0; col < map.cols; col++) {
+            float elevation = map.at(row, col);
+            if (!(std::fabs(elevation) < 1e5f)) {
+                return false;
+            }
+            long hundredths = lrintf(elevation * 100.0f);
+            if ((float)hundredths / 100.0f != elevation) {
+                return false;
+            }
+            lowest = std::min(lowest, hundredths);
+            highest = std::max(highest, hundredths);
+        }
+        if (highest - lowest > UINT16_MAX) {
+            return false;
+        }
+    }
+
+    // Same layout (row-major or tiled) as the float elevations
+    size_t numCells = map.tileOffsets.empty() ? (size_t)map.rows * map.cols : map.tileOffsets.size() * MAP_TILE_SIZE * MAP_TILE_SIZE;
+    // One more, unused, element: the batch descent gathers the elevations as 32-bit words
+    PlacedVector<int16_t> compactStorage(numCells + 1, 0);
+    const int32_t base = (int32_t)lowest - INT16_MIN;
+    for (int row = 0; row < map.rows; row++) {
+        for (int col = 0; col < map.cols; col++) {
+            compactStorage[map.offset(row, col)] = (int16_t)(lrintf(map.at(row, col) * 100.0f) - base);
+        }
+    }
+
+    map.compactStorage = std::move(compactStorage);
+    map.compactBase = base;
+    map.storage.clear();
+    map.storage.shrink_to_fit();
+    map.backing.reset();
+    map.cells = nullptr;
+    return true;
+}
+
+// Store the elevations of a map in floating point, in the layout they are in
+static void ownFloatElevations(ElevationMap& map) {
+    size_t numCells = map.tileOffsets.empty() ? (size_t)map.rows * map.cols : map.tileOffsets.size() * MAP_TILE_SIZE * MAP_TILE_SIZE;
+    PlacedVector<float> storage(numCells, 0.f);
+    for (int row = 0; row < map.rows; row++) {
+        for (int col = 0; col < map.cols; col++) {
+            storage[map.offset(row, col)] = map.at(row, col);
+        }
+    }
+    map.storage = std::move(storage);
+    map.cells = map.storage.data();
+    map.backing.reset();
+    map.compactStorage.clear();
+    map.compactStorage.shrink_to_fit();
+}
+
+void setElevations(ElevationMap& map, int row, int col, int rows, int cols, const float* elevations) {
+    if (map.compact()) {
+        for (size_t k = 0; k < (size_t)rows * cols; k++) {
+            long hundredths = std::fabs(elevations[k]) < 1e5f ? lrintf(elevations[k] * 100.0f) : LONG_MAX;
+            if (hundredths == LONG_MAX || (float)hundredths / 100.0f != elevations[k] ||
+                hundredths - map.compactBase < INT16_MIN || hundredths - map.compactBase > INT16_MAX) {
+                ownFloatElevations(map);
+                break;
+            }
+        }
+    } else if (map.storage.empty()) {
+        ownFloatElevations(map);
+    }
+
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            float elevation = elevations[(size_t)i * cols + j];
+            size_t offset = map.offset(row + i, col + j);
+            if (map.compact()) {
+                map.compactStorage[offset] = (int16_t)(lrintf(elevation * 100.0f) - map.compactBase);
+            } else {
+                map.storage[offset] = elevation;
+            }
+        }
+    }
+}
+
+// Calculate the lowest point path from a (0-based) start point
+std::vector<std::pair<int, int>> steepestDescent(const ElevationMap& map, int startRow, int startCol) {
+
+    std::vector<std::pair<int, int>> path; // Store the path the skier followed
+    int currentRow = startRow;
+    int currentCol = startCol;
+    path.push_back({currentRow, currentCol});
+
+    while (true) {
+        // Look for the lowest of the (up to 8) neighbors. Neighbors are visited in
+        // the same order as in the previous versions, and only a strictly lower
+        // neighbor replaces the current best, so ties resolve identically.
+        int nextRow = currentRow;
+        int nextCol = currentCol;
+        float lowestElevation = map.at(currentRow, currentCol);
+
+        for (int i = -1; i <= 1; ++i) {
+            int row = currentRow + i;
+            if (row < 0 || row >= map.rows) continue;
+            for (int j = -1; j <= 1; ++j) {
+                int col = currentCol + j;
+                if ((i == 0 && j == 0) || col < 0 || col >= map.cols) continue;
+                if (map.at(row, col) < lowestElevation) {
+                    lowestElevation = map.at(row, col);
+                    nextRow = row;
+                    nextCol = col;
+                }
+            }
+        }
+
+        // No lower neighbor: the skier has reached a local minimum
+        if (nextRow == currentRow && nextCol == currentCol) {
+            break;
+        }
+
+        currentRow = nextRow;
+        currentCol = nextCol;
+        path.push_back({currentRow, currentCol});
+    }
+
+    return path;
+}
+
+// Get the map file name (no folder, no extension)
+std::string extractMapName(const std::string& mapFilePath) {
+    size_t start = mapFilePath.find_last_of("/\\");
+    start = (start == std::string::npos) ? 0 : start + 1;
+    size_t end = mapFilePath.find('.', start);
+    if (end == std::string::npos) {
+        end = mapFilePath.size();
+    }
+    return mapFilePath.substr(start, end - start);
+}
@@ -0,0 +1,101 @@
+#ifndef ELEVATION_MAP_H
+#define ELEVATION_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <utility>
+#include <memory>
+
+#include "memoryPlacement.h"
+
+// Maps can be stored in square tiles of MAP_TILE_SIZE x MAP_TILE_SIZE elevations
+const int MAP_TILE_SHIFT = 6;
+const int MAP_TILE_SIZE = 1 << MAP_TILE_SHIFT;
+const int MAP_TILE_MASK = MAP_TILE_SIZE - 1;
+
+// An elevation map kept resident by a skier dispatcher.
+// The elevations are stored row-major in a single flat array so that the map
+// is read once and then shared (read-only) by every skier of every task.
+// That array is either owned by the map (storage) or lives in memory owned by
+// someone else, e.g. a shared memory segment (backing).
+// A tiled map stores the elevations tile by tile instead (see tileMap), and a
+// fixed-point map as 16-bit integers (see compactMap), both of which at()
+// hides from the code reading the map.
+struct ElevationMap {
+    int rows = 0; // number of rows of the map
+    int cols = 0; // number of columns of the map
+    const float* cells = nullptr; // row-major elevations
+    PlacedVector<float> storage; // elevations, when owned by this map
+    std::shared_ptr<const void> backing; // keeps external elevations alive
+    std::vector<size_t> tileOffsets; // offset of each tile in cells (row-major tile order), when tiled
+    int tileCols = 0; // number of tiles across the map, when tiled
+    PlacedVector<int16_t> compactStorage; // elevations in hundredths, minus compactBase, when fixed-point
+    int32_t compactBase = 0;
+
+    ElevationMap() = default;
+    ElevationMap(const ElevationMap&) = delete;
+    ElevationMap& operator=(const ElevationMap&) = delete;
+    ElevationMap(ElevationMap&&) = default;
+    ElevationMap& operator=(ElevationMap&&) = default;
+
+    // Where the elevation of a given (0-based) row and column is stored
+    size_t offset(int row, int col) const {
+        if (tileOffsets.empty()) {
+            return (size_t)row * cols + col;
+        }
+        return tileOffsets[(size_t)(row >> MAP_TILE_SHIFT) * tileCols + (col >> MAP_TILE_SHIFT)] +
+               ((row & MAP_TILE_MASK) << MAP_TILE_SHIFT | (col & MAP_TILE_MASK));
+    }
+
+    // Checks if the elevations are stored in fixed point
+    bool compact() const { return !compactStorage.empty(); }
+
+    // Elevation at a given (0-based) row and column. A fixed-point elevation is
+    // converted back to the exact float it was read as (the division of an
+    // integer by 100 rounds the same way as reading its decimals does).
+    float at(int row, int col) const {
+        if (compact()) {
+            return (float)(compactBase + compactStorage[offset(row, col)]) / 100.0f;
+        }
+        return cells[offset(row, col)];
+    }
+
+    // Fixed-point elevation at a given (0-based) row and column (offset by
+    // compactBase): compares as the elevations do, without the conversion
+    int16_t compactAt(int row, int col) const { return compactStorage[offset(row, col)]; }
+
+    // Checks if a (0-based) point lies on the map
+    bool contains(int row, int col) const { return row >= 0 && row < rows && col >= 0 && col < cols; }
+};
+
+// Read in the map file ("rows cols" header followed by the elevations)
+bool readMap(const std::string& filePath, ElevationMap& map);
+// Read only the dimensions of a map file
+bool readMapSize(const std::string& filePath, int& rows, int& cols);
+// Store a map in tiles, the tiles in Morton (Z) order, so that the cells
+// around a point are close in memory whichever way a skier goes (row-major,
+// every step to another row is a jump of a whole row). The map gets its own
+// copy of the elevations.
+void tileMap(ElevationMap& map);
+// Offset (in cells) of each tile of a tiled map, tiles numbered row-major
+std::vector<size_t> mortonTileOffsets(int tileRows, int tileCols);
+// Store the elevations of a map as 16-bit integers (hundredths of a unit),
+// halving the memory they take. Only done if every elevation has at most two
+// decimals and the range of the map fits in 16 bits, so that the elevations
+// compare exactly as before; returns false (and leaves the map as it is)
+// otherwise. The map drops its float elevations.
+bool compactMap(ElevationMap& map);
+// Change the elevations of a rectangle of a map (row-major elevations, the
+// rectangle on the map). A map whose elevations live in someone else's memory
+// (shared memory) first gets its own copy; a fixed-point map goes back to
+// floating point if a new elevation does not fit.
+void setElevations(ElevationMap& map, int row, int col, int rows, int cols, const float* elevations);
+// Memory a tiled rows x cols map takes (edge tiles are padded)
+size_t tiledMapBytes(int rows, int cols);
+// Calculate the lowest point path from a (0-based) start point
+std::vector<std::pair<int, int>> steepestDescent(const ElevationMap& map, int startRow, int startCol);
+// Get the map file name (no folder, no extension)
+std::string extractMapName(const std::string& mapFilePath);
+
+#endif // ELEVATION_MAP_H
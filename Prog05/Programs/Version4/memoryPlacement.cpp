@@ -0,0 +1,141 @@
+#include "memoryPlacement.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25 // Linux 6.1, missing from older C libraries
+#endif
+
+const size_t DEFAULT_HUGE_PAGE_SIZE = 2 << 20;
+
+static std::atomic<bool> placeOnHugePages{false};
+
+// Size of a transparent huge page, as the kernel reports it
+static size_t hugePageSize() {
+    static const size_t size = []() {
+        std::ifstream sizeFile("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+        size_t bytes = 0;
+        return (sizeFile >> bytes) && bytes > 0 ? bytes : DEFAULT_HUGE_PAGE_SIZE;
+    }();
+    return size;
+}
+
+// Nodes with memory, from a list of node ranges such as "0-1,3"
+static std::vector<int> memoryNodes() {
+    std::ifstream nodesFile("/sys/devices/system/node/has_memory");
+    std::string nodes;
+    std::vector<int> nodeIds;
+    if (!std::getline(nodesFile, nodes)) {
+        return nodeIds;
+    }
+    size_t position = 0;
+    while (position < nodes.size()) {
+        size_t end = nodes.find(',', position);
+        if (end == std::string::npos) {
+            end = nodes.size();
+        }
+        std::string range = nodes.substr(position, end - position);
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int node = first; node <= last; node++) {
+            nodeIds.push_back(node);
+        }
+        position = end + 1;
+    }
+    return nodeIds;
+}
+
+int numaNodes() {
+    return std::max<int>(1, memoryNodes().size());
+}
+
+bool interleaveAllocations(bool interleave) {
+    if (!interleave) {
+        return syscall(SYS_set_mempolicy, MPOL_DEFAULT, nullptr, 0) == 0;
+    }
+    const size_t BITS_PER_WORD = sizeof(unsigned long) * 8;
+    std::vector<unsigned long> nodeMask;
+    for (int node : memoryNodes()) {
+        nodeMask.resize(std::max(nodeMask.size(), node / BITS_PER_WORD + 1), 0);
+        nodeMask[node / BITS_PER_WORD] |= 1UL << (node % BITS_PER_WORD);
+    }
+    if (nodeMask.empty()) {
+        return false;
+    }
+    // The kernel reads one bit less than it is told to
+    return syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, nodeMask.data(), nodeMask.size() * BITS_PER_WORD + 1) == 0;
+}
+
+bool useHugePages(const void* address, size_t bytes) {
+    const uintptr_t pageSize = hugePageSize();
+    uintptr_t begin = ((uintptr_t)address + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)address + bytes) & ~(pageSize - 1);
+    if (end <= begin) {
+        return true;
+    }
+    // Future faults get huge pages; the pages already touched are collapsed now.
+    // Collapsing is best effort (before Linux 6.1, or short of free huge pages,
+    // the pages stay small until khugepaged gets to them).
+    if (madvise((void*)begin, end - begin, MADV_HUGEPAGE) != 0) {
+        return false;
+    }
+    madvise((void*)begin, end - begin, MADV_COLLAPSE);
+    return true;
+}
+
+void hugePageAllocations(bool enable) {
+    placeOnHugePages.store(enable, std::memory_order_relaxed);
+}
+
+long hugePagesKb() {
+    // Private (map, index) and shared (--shm segments) memory mapped with huge pages
+    std::ifstream rollup("/proc/self/smaps_rollup");
+    std::string field;
+    long kb = 0;
+    bool found = false;
+    while (rollup >> field) {
+        long value = 0;
+        if ((field == "AnonHugePages:" || field == "ShmemPmdMapped:") && (rollup >> value)) {
+            kb += value;
+            found = true;
+        }
+        rollup.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    return found ? kb : -1;
+}
+
+void* allocatePlaced(size_t bytes) {
+    const size_t pageSize = hugePageSize();
+    void* address = nullptr;
+    if (placeOnHugePages.load(std::memory_order_relaxed) && bytes >= pageSize) {
+        // Whole huge pages, so that the end of the block is covered too
+        size_t alignedBytes = (bytes + pageSize - 1) & ~(pageSize - 1);
+        if (posix_memalign(&address, pageSize, alignedBytes) != 0) {
+            throw std::bad_alloc();
+        }
+        // A refusal leaves the block on small pages; useHugePages reports it once the block is filled
+        madvise(address, alignedBytes, MADV_HUGEPAGE);
+        return address;
+    }
+    address = malloc(std::max<size_t>(bytes, 1));
+    if (address == nullptr) {
+        throw std::bad_alloc();
+    }
+    return address;
+}
+
+void freePlaced(void* address) {
+    free(address);
+}
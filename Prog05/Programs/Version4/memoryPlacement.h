@@ -0,0 +1,66 @@
+#ifndef MEMORY_PLACEMENT_H
+#define MEMORY_PLACEMENT_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Placement of the memory a skier dispatcher keeps resident.
+//
+// A skier wanders over its map, so the elevations and the descent index of a
+// large map are read all over, and most of their reads miss the TLB with 4 KiB
+// pages. Backing them with transparent huge pages (2 MiB) makes a TLB entry
+// cover 512 times more of the map. The storage is allocated aligned to huge
+// pages, and advised before it is filled, so that its pages fault in huge
+// rather than having to be collapsed afterwards.
+//
+// On a host with several NUMA nodes, the worker threads of a dispatcher run on
+// every node, while the pages of the map would all be allocated on the node of
+// the thread that read it. Interleaving those pages over the nodes spreads the
+// reads of the workers over the memory controllers of all the nodes.
+
+// Number of NUMA nodes with memory (1 if the host is not NUMA)
+int numaNodes();
+
+// Interleave the pages this process allocates from now on over every node
+// (true), or go back to allocating them on the node of the thread that
+// touches them first (false). Returns false if the kernel refused.
+bool interleaveAllocations(bool interleave);
+
+// Back the pages of a block of memory with transparent huge pages, including
+// those already touched. Only whole huge pages inside the block are affected.
+// Returns false if the kernel refused (no transparent huge pages).
+bool useHugePages(const void* address, size_t bytes);
+
+// Allocate the blocks of a huge page or more that this process allocates from
+// now on through PlacedAllocator aligned to huge pages, and advised to be
+// backed by them before they are touched (true), or as usual (false)
+void hugePageAllocations(bool enable);
+
+// Memory of this process backed by huge pages, in KB (-1 if unknown)
+long hugePagesKb();
+
+// Allocation and release of the blocks of PlacedAllocator (std::bad_alloc on failure)
+void* allocatePlaced(size_t bytes);
+void freePlaced(void* address);
+
+// Allocator of the storage a skier dispatcher keeps resident (see hugePageAllocations)
+template <typename T>
+struct PlacedAllocator {
+    using value_type = T;
+
+    PlacedAllocator() = default;
+    template <typename U>
+    PlacedAllocator(const PlacedAllocator<U>&) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(allocatePlaced(count * sizeof(T))); }
+    void deallocate(T* address, size_t) { freePlaced(address); }
+
+    template <typename U>
+    bool operator==(const PlacedAllocator<U>&) const { return true; }
+};
+
+template <typename T>
+using PlacedVector = std::vector<T, PlacedAllocator<T>>;
+
+#endif // MEMORY_PLACEMENT_H
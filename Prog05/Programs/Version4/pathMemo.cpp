@@ -0,0 +1,112 @@
+#include "pathMemo.h"
+
+PathMemo::PathMemo(const ElevationMap& map, const DescentIndex* index, const DescentField* field, bool memoize)
+    : map(map), index(index), field(field), memoize(memoize && index == nullptr && field == nullptr) {
+    size_t numCells = (size_t)map.rows * map.cols;
+    if (numCells > UINT32_MAX) {
+        this->memoize = false; // ends of paths are recorded on 32 bits
+    }
+    if (this->memoize) {
+        direction = std::vector<std::atomic<uint8_t>>(numCells);
+        known = std::vector<std::atomic<uint64_t>>(numCells);
+        for (auto& d : direction) {
+            d.store(UNKNOWN, std::memory_order_relaxed);
+        }
+    }
+}
+
+int64_t PathMemo::next(int64_t cell) {
+    if (index != nullptr) {
+        return index->next((int32_t)cell);
+    }
+    if (field != nullptr) {
+        return field->next(cell);
+    }
+    uint8_t d = memoize ? direction[cell].load(std::memory_order_relaxed) : UNKNOWN;
+    if (d == UNKNOWN) {
+        d = descentDirection(map, cell / map.cols, cell % map.cols);
+        if (memoize) {
+            direction[cell].store(d, std::memory_order_relaxed);
+        }
+    }
+    return (d == LOCAL_MINIMUM) ? cell : cell + DESCENT_ROW_STEP[d] * map.cols + DESCENT_COL_STEP[d];
+}
+
+void PathMemo::tail(int64_t cell, int64_t& end, int64_t& length) {
+    if (index != nullptr) {
+        end = index->basin[cell];
+        length = index->pathLength[cell];
+        return;
+    }
+
+    // Go down to the bottom, or to the first cell whose tail is known
+    std::vector<int64_t> trail;
+    int64_t tailEnd, tailLength;
+    for (;;) {
+        uint64_t knownTail;
+        if (memoize && (knownTail = known[cell].load(std::memory_order_relaxed)) != 0) {
+            tailEnd = (uint32_t)knownTail;
+            tailLength = (int64_t)(knownTail >> 32);
+            break;
+        }
+        int64_t nextCell = next(cell);
+        if (nextCell == cell) {
+            tailEnd = cell;
+            tailLength = 1;
+            break;
+        }
+        trail.push_back(cell);
+        cell = nextCell;
+    }
+    end = tailEnd;
+    length = tailLength + (int64_t)trail.size();
+
+    if (memoize) {
+        known[cell].store((uint64_t)tailLength << 32 | (uint32_t)tailEnd, std::memory_order_relaxed);
+        for (size_t i = trail.size(); i-- > 0;) {
+            tailLength++;
+            known[trail[i]].store((uint64_t)tailLength << 32 | (uint32_t)tailEnd, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::vector<std::pair<int, int>> PathMemo::path(int startRow, int startCol) {
+    int64_t cell = (int64_t)startRow * map.cols + startCol;
+    std::vector<std::pair<int, int>> points;
+    if (index != nullptr) {
+        points.reserve(index->pathLength[cell]);
+    }
+    points.push_back({startRow, startCol});
+    for (int64_t nextCell = next(cell); nextCell != cell; nextCell = next(cell)) {
+        cell = nextCell;
+        points.push_back({(int)(cell / map.cols), (int)(cell % map.cols)});
+    }
+    return points;
+}
+
+SharedTails::SharedTails(size_t numCells) : first(numCells) {
+    for (auto& f : first) {
+        f.store(UINT64_MAX, std::memory_order_relaxed);
+    }
+}
+
+bool SharedTails::claim(int64_t cell, uint32_t skier, uint32_t point) {
+    // Keep the earliest skier. A skier that gives up a cell to an earlier one
+    // stops there, and the earlier one (or an even earlier one it meets further
+    // down) claims the rest of the path, so once every skier up to a given one
+    // is done, every cell of its path names the earliest skier through it.
+    uint64_t mine = (uint64_t)skier << 32 | point;
+    uint64_t current = first[cell].load(std::memory_order_relaxed);
+    while (current > mine) {
+        if (first[cell].compare_exchange_weak(current, mine, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return (current >> 32) == skier;
+}
+
+void SharedTails::owner(int64_t cell, uint32_t& skier, uint32_t& point) const {
+    uint64_t value = first[cell].load(std::memory_order_relaxed);
+    skier = (uint32_t)(value >> 32);
+    point = (uint32_t)value;
+}
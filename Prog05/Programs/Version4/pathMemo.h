@@ -0,0 +1,68 @@
+#ifndef PATH_MEMO_H
+#define PATH_MEMO_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "elevationMap.h"
+#include "descentIndex.h"
+#include "descentField.h"
+
+// What the skiers of a task know about the paths down a map.
+//
+// On an indexed map, everything is known from the start, and on a map with a
+// descent field (a binary map), every direction is. Otherwise the skiers
+// of a task record as they go, for every cell they visit, the direction they
+// left it in and (once they reach the bottom) where the path from there ends
+// and how long it is. A later skier whose path joins an earlier one stops
+// searching at the first cell it finds recorded and takes the rest of its path
+// from the memo. Paths on the same map merge quickly, so most of the steps of
+// most skiers come from the memo. The memo is shared by the workers of a task
+// (every worker records the same values for a cell, so they can race freely).
+class PathMemo {
+public:
+    // `memoize` is ignored on a map with an index or a field. Without it, every step is a search.
+    PathMemo(const ElevationMap& map, const DescentIndex* index, const DescentField* field, bool memoize);
+
+    // Cell a skier moves to from a given cell (itself for a local minimum).
+    // Cells are numbered row-major, on 64 bits for the largest (binary) maps.
+    int64_t next(int64_t cell);
+
+    // Cell where the path from a given cell ends, and its number of points
+    void tail(int64_t cell, int64_t& end, int64_t& length);
+
+    // Path of a skier (same result as steepestDescent)
+    std::vector<std::pair<int, int>> path(int startRow, int startCol);
+
+private:
+    static const uint8_t UNKNOWN = 0xFF;
+
+    const ElevationMap& map;
+    const DescentIndex* index;
+    const DescentField* field;
+    bool memoize;
+    std::vector<std::atomic<uint8_t>> direction; // UNKNOWN until a skier leaves the cell
+    std::vector<std::atomic<uint64_t>> known;    // (length << 32 | end), 0 until known
+};
+
+// The first skier of a task (in start-point order) through each cell, for the
+// compact TRACE output, in which a skier's path stops where it joins the path
+// of an earlier skier and refers to the rest of that path instead.
+class SharedTails {
+public:
+    explicit SharedTails(size_t numCells);
+
+    // Record that a skier reaches a cell as the given point of its path.
+    // Returns false if an earlier skier already went through that cell: the
+    // rest of the path is then known, and the skier can stop there.
+    bool claim(int64_t cell, uint32_t skier, uint32_t point);
+
+    // First skier through a cell, and the point of its path that cell is
+    void owner(int64_t cell, uint32_t& skier, uint32_t& point) const;
+
+private:
+    std::vector<std::atomic<uint64_t>> first; // (skier << 32 | point)
+};
+
+#endif // PATH_MEMO_H
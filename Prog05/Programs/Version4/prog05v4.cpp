@@ -2,49 +2,573 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
-// Use std::vector or any suitable data structure to manage child processes
-std::vector<pid_t> skier_dispatchers;
+#include "skierDispatcher.h"
+#include "taskFile.h"
+#include "binaryMap.h"
+
+// General dispatcher (Version 4).
+//
+// Runs for as long as the script does. The script sends it, one per line, the
+// path of every map or task file dropped in the watch folder:
+//  - a map file launches a skier dispatcher process for that map, which reads
+//    the map once and keeps it resident (a binary .bmap map, too large to be
+//    read, is mapped instead, and served from its descent field);
+//  - a task file is forwarded (as a path, through a pipe) to the skier
+//    dispatcher of its map, so no task ever re-reads a map. The tasks of a
+//    map take turns, a few thousand skiers at a time, so a small task is not
+//    held up behind a large one; a "PRIORITY <n>" line before the number of
+//    skiers runs n times as many skiers in each turn of the task;
+//  - a PATCH task changes part of a map: it is forwarded the same way, and
+//    applied again whenever the map is brought back after an eviction;
+//  - a BASINS task (BASINS TGA for an image too) has the skier dispatcher of
+//    its map write the basin and path length of every cell as rasters;
+//  - an "END <map>" task ends the skier dispatcher of that map, "END" or
+//    "END ALL" ends all of them and then the general dispatcher itself.
+//
+// Resident maps (and the indexes their skier dispatchers derive from them) form
+// an LRU cache: when a memory budget is given, launching a skier dispatcher
+// first ends the least recently used ones until everything fits. An evicted
+// map is still known; its skier dispatcher is relaunched by its next task.
+//
+// Usage: general_dispatcher [options] <output_folder> [command_fifo]
+// Commands are read from the named pipe command_fifo (created if needed) or,
+// if none is given, from the standard input. A "STATS" command prints the
+// cache counters.
+//
+// With --watch, the general dispatcher takes the files in itself: it watches
+// the folder with inotify, and takes every map or task file in as soon as it
+// is closed after writing (or moved into the folder), with the files already
+// there when it starts first. Commands are then only read from command_fifo,
+// if one is given.
+// Options:
+//  --watch <folder>       take in the map and task files written to a folder;
+//  --shm                  maps are published in (or attached from) POSIX shared
+//                         memory, so that skier dispatchers of different general
+//                         dispatchers share one copy;
+//  --cache-budget <MB>    memory budget for the resident maps (default: none);
+//  --no-index             skiers search the map instead of using a descent index;
+//  --tiled                maps are stored in 64x64 tiles rather than row by row
+//                         (better locality on maps much larger than the cache);
+//  --fixed-point          maps whose elevations all have at most two decimals are
+//                         stored as 16-bit integers (half the memory of floats);
+//  --compact-trace        a TRACE path stops where it joins the path of an earlier
+//                         skier of the task, with "-> <skier> <point>" in place of
+//                         the rest of it (the output then starts with COMPACT_TRACE);
+//  --stats[=json]         every skier dispatcher prints, for each task, the time
+//                         spent parsing it, loading the map, building the index,
+//                         running the skiers and writing the output, with counts
+//                         of skiers and steps, path lengths, bytes written,
+//                         peak RSS and memory on huge pages (on the standard
+//                         error, as text or JSON);
+//  --binary-output        tasks write <map>.bout instead of <map>.txt: a binary
+//                         record per skier, TRACE paths packed in 3 bits a point
+//                         (Scripts/decode05.sh turns it back into the text output);
+//  --huge-pages           resident maps and their indexes are allocated on transparent
+//                         huge pages (fewer TLB misses on large maps);
+//  --numa-interleave      on a host with several NUMA nodes, the pages of resident
+//                         maps and their indexes are interleaved over the nodes,
+//                         so that the workers on every node share the bandwidth.
+
+// A skier dispatcher process launched by the general dispatcher
+struct SkierDispatcherInfo {
+    std::string mapFilePath;
+    pid_t pid = -1;     // -1 when the map is not resident
+    int commandFd = -1; // write end of the pipe the task paths are sent through
+    bool ended = false; // ended by an END task
+    size_t residentBytes = 0;  // memory held by the skier dispatcher for its map
+    unsigned long lastUse = 0; // for the LRU eviction
+    int tasksSent = 0;         // numbers the output files, across relaunches
+    std::vector<std::string> patches; // patch task files applied to the map, replayed on relaunch
+};
+
+// Counters of the map cache
+struct MapCacheStats {
+    unsigned long hits = 0;      // tasks sent to a resident map
+    unsigned long misses = 0;    // maps (re)loaded by a new skier dispatcher
+    unsigned long evictions = 0; // skier dispatchers ended to stay within the budget
+};
+
+// Skier dispatchers, indexed by map name
+std::map<std::string, SkierDispatcherInfo> skier_dispatchers;
+// Path to the output folder given to every skier dispatcher
+std::string output_folder;
+// File descriptor commands are read from (-1 if none), closed in the skier dispatchers
+int command_fd = STDIN_FILENO;
+// Watch folder (--watch), and the inotify descriptor watching it (closed in the skier dispatchers)
+std::string watch_folder;
+int watch_fd = -1;
+// Options every skier dispatcher is launched with
+SkierDispatcherOptions dispatcher_options;
+// Memory budget for the resident maps, in bytes (0: no budget)
+size_t cache_budget = 0;
+// Memory currently held by the resident maps
+size_t cache_resident_bytes = 0;
+// Logical clock for the LRU ordering
+unsigned long cache_clock = 0;
+MapCacheStats cache_stats;
+// Evicted skier dispatchers finishing their last tasks, not waited for yet
+std::vector<pid_t> evicted_dispatchers;
 
 // Function to spawn a new Skier Dispatcher process
+void spawn_skier_dispatcher(const std::string& map_file);
+// Fork the skier dispatcher of a known map, making room for it in the cache
+void launch_skier_dispatcher(const std::string& mapName, SkierDispatcherInfo& dispatcher);
+// Function to process task files and dispatch tasks to Skier Dispatchers.
+// Returns false when the task asks for everything to end.
+bool process_task_file(const std::string& task_file);
+// End least recently used skier dispatchers until a new map of the given size fits in the budget
+void make_room_in_cache(size_t bytes);
+// End a skier dispatcher to free its memory; its map stays known
+void evict_skier_dispatcher(SkierDispatcherInfo& dispatcher);
+// Wait for evicted skier dispatchers that are done
+void reap_evicted_dispatchers(bool block);
+// Terminate one skier dispatcher after it is done with the tasks it was sent
+void end_skier_dispatcher(SkierDispatcherInfo& dispatcher);
+// Terminate all skier dispatchers
+void end_all_skier_dispatchers();
+// Print the map cache counters
+void print_cache_stats();
+// Take in a map or task file path, or a command. Returns false when a task asks for everything to end.
+bool handle_path(const std::string& path);
+// Take in several paths at once: maps first, so that a map and its task arriving together are both handled
+bool handle_paths(std::vector<std::string>& paths);
+// Start watching the watch folder, and take in the files already in it
+bool start_watching(bool& keepRunning);
+// Take in the files written to (or moved into) the watch folder since the last call
+bool handle_watch_events();
+
+int main(int argc, char* argv[]) {
+    // Options come first
+    int arg = 1;
+    while (arg < argc && argv[arg][0] == '-') {
+        std::string option = argv[arg];
+        if (option == "--shm") {
+            dispatcher_options.sharedMaps = true;
+        } else if (option == "--no-index") {
+            dispatcher_options.useIndex = false;
+        } else if (option == "--tiled") {
+            dispatcher_options.tiledMaps = true;
+        } else if (option == "--fixed-point") {
+            dispatcher_options.fixedPoint = true;
+        } else if (option == "--compact-trace") {
+            dispatcher_options.compactTrace = true;
+        } else if (option == "--binary-output") {
+            dispatcher_options.binaryOutput = true;
+        } else if (option == "--huge-pages") {
+            dispatcher_options.hugePages = true;
+        } else if (option == "--numa-interleave") {
+            dispatcher_options.numaInterleave = true;
+        } else if (option == "--stats") {
+            dispatcher_options.stats = StatsFormat::TEXT;
+        } else if (option == "--stats=json") {
+            dispatcher_options.stats = StatsFormat::JSON;
+        } else if (option == "--watch" && arg + 1 < argc) {
+            watch_folder = argv[++arg];
+            if (watch_folder.size() > 1 && watch_folder.back() == '/') {
+                watch_folder.pop_back();
+            }
+        } else if (option == "--cache-budget" && arg + 1 < argc) {
+            cache_budget = (size_t)(atof(argv[++arg]) * 1024 * 1024);
+        } else {
+            std::cerr << "Unknown option: " << argv[arg] << std::endl;
+            return EXIT_FAILURE;
+        }
+        arg++;
+    }
+
+    if (argc - arg < 1) {
+        std::cerr << "Usage: " << argv[0] << " [--shm] [--cache-budget <MB>] [--no-index] [--tiled] [--fixed-point] [--compact-trace] [--binary-output] [--huge-pages] [--numa-interleave] [--stats[=json]] [--watch <folder>] <output_folder> [command_fifo]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    output_folder = argv[arg];
+    if (output_folder.size() > 1 && output_folder.back() == '/') {
+        output_folder.pop_back();
+    }
+    struct stat folderInfo;
+    if (stat(output_folder.c_str(), &folderInfo) != 0 || !S_ISDIR(folderInfo.st_mode)) {
+        std::cerr << "Output folder not found: " << output_folder << std::endl;
+        return 11;
+    }
+
+    std::string fifo_path;
+    if (argc - arg > 1) {
+        fifo_path = argv[arg + 1];
+        if (mkfifo(fifo_path.c_str(), 0600) == -1 && errno != EEXIST) {
+            perror("mkfifo");
+            return EXIT_FAILURE;
+        }
+        // Opened for reading and writing so that we never see an end of file
+        // between two writes of the script.
+        command_fd = open(fifo_path.c_str(), O_RDWR);
+        if (command_fd == -1) {
+            perror("open command fifo");
+            return EXIT_FAILURE;
+        }
+    } else if (!watch_folder.empty()) {
+        command_fd = -1; // the files come from the watch folder only
+    }
+
+    // A skier dispatcher that died must not take the general dispatcher down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    bool keepRunning = true;
+    if (!watch_folder.empty() && !start_watching(keepRunning)) {
+        return EXIT_FAILURE;
+    }
+
+    // Main loop: commands from the script (one per line), and files from the
+    // watch folder, whichever comes first
+    std::string pending; // start of a command line not complete yet
+    char buffer[1 << 12];
+    while (keepRunning && (command_fd != -1 || watch_fd != -1)) {
+        struct pollfd sources[2] = {{command_fd, POLLIN, 0}, {watch_fd, POLLIN, 0}};
+        if (poll(sources, 2, -1) == -1) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+        if (sources[1].revents != 0) {
+            keepRunning = handle_watch_events();
+        }
+        if (keepRunning && sources[0].revents != 0) {
+            ssize_t bytesRead = read(command_fd, buffer, sizeof(buffer));
+            if (bytesRead <= 0) {
+                if (bytesRead == -1 && errno == EINTR) continue;
+                // End of the commands: done, unless the watch folder still brings files
+                close(command_fd);
+                command_fd = -1;
+                if (!pending.empty()) {
+                    pending += '\n'; // a last command without its newline
+                }
+            } else {
+                pending.append(buffer, bytesRead);
+            }
+            std::vector<std::string> paths;
+            size_t newline;
+            while ((newline = pending.find('\n')) != std::string::npos) {
+                paths.push_back(pending.substr(0, newline));
+                pending.erase(0, newline + 1);
+            }
+            // Commands are taken in the order they come
+            for (size_t i = 0; i < paths.size() && keepRunning; i++) {
+                keepRunning = handle_path(paths[i]);
+            }
+        }
+        reap_evicted_dispatchers(false);
+    }
+
+    // Wait for all child processes to finish before exiting
+    end_all_skier_dispatchers();
+    reap_evicted_dispatchers(true);
+    print_cache_stats();
+
+    if (command_fd != -1) {
+        close(command_fd);
+    }
+    if (watch_fd != -1) {
+        close(watch_fd);
+    }
+    if (!fifo_path.empty()) {
+        unlink(fifo_path.c_str());
+    }
+    return EXIT_SUCCESS;
+}
+
 void spawn_skier_dispatcher(const std::string& map_file) {
-    // Fork and exec logic to spawn skier dispatcher
+    const std::string mapName = extractMapName(map_file);
+    SkierDispatcherInfo& dispatcher = skier_dispatchers[mapName];
+    if (dispatcher.pid != -1) {
+        // Already resident
+        dispatcher.lastUse = ++cache_clock;
+        return;
+    }
+
+    // A new map, an evicted one, or one that was ended and is dropped again
+    dispatcher.mapFilePath = map_file;
+    dispatcher.ended = false;
+    cache_stats.misses++;
+    launch_skier_dispatcher(mapName, dispatcher);
 }
 
-// Function to process task files and dispatch tasks to Skier Dispatchers
-void process_task_file(const std::string& task_file) {
-    // Read the task file and dispatch tasks to the skier dispatcher processes
+void launch_skier_dispatcher(const std::string& mapName, SkierDispatcherInfo& dispatcher) {
+    // Only the header of the map is read here: the map itself is read by the skier dispatcher
+    int rows = 0, cols = 0;
+    size_t bytes = 0;
+    bool sized = isBinaryMap(dispatcher.mapFilePath) ? readBinaryMapSize(dispatcher.mapFilePath, rows, cols)
+                                                     : readMapSize(dispatcher.mapFilePath, rows, cols);
+    if (sized) {
+        bytes = residentMapBytes(dispatcher.mapFilePath, rows, cols, dispatcher_options);
+    }
+    make_room_in_cache(bytes);
+
+    int fds[2];
+    if (pipe(fds) == -1) {
+        std::cerr << "Failed to create a pipe" << std::endl;
+        exit(3);
+    }
+
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) { // Skier dispatcher process
+        // Only keep our own end of our own pipe, so that every skier dispatcher
+        // sees the end of its commands as soon as the general dispatcher closes them.
+        close(fds[1]);
+        if (command_fd != -1) {
+            close(command_fd);
+        }
+        if (watch_fd != -1) {
+            close(watch_fd);
+        }
+        for (auto& [name, other] : skier_dispatchers) {
+            if (other.commandFd != -1) {
+                close(other.commandFd);
+            }
+        }
+        _exit(runSkierDispatcher(dispatcher.mapFilePath, output_folder, fds[0], dispatcher_options));
+    } else if (pid < 0) {
+        std::cerr << "Failed to fork the skier dispatcher for " << mapName << std::endl;
+        exit(2);
+    }
+
+    close(fds[0]);
+    dispatcher.pid = pid;
+    dispatcher.commandFd = fds[1];
+    dispatcher.residentBytes = bytes;
+    dispatcher.lastUse = ++cache_clock;
+    cache_resident_bytes += bytes;
+
+    // A map brought back after an eviction is read again from its file: patch it again
+    for (const auto& patch : dispatcher.patches) {
+        std::string message = "0 " + patch + "\n";
+        if (write(dispatcher.commandFd, message.c_str(), message.size()) != (ssize_t)message.size()) {
+            break;
+        }
+    }
 }
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <output_folder>" << std::endl;
-        return EXIT_FAILURE;
+bool process_task_file(const std::string& task_file) {
+    // Only the head of the file, to find its map: the start points (or the
+    // elevations of a patch) are left to the skier dispatcher, so that a large
+    // task does not hold up the commands for the other maps
+    Task task;
+    if (!parseTaskHeader(task_file, task)) {
+        std::cerr << "Invalid task file: " << task_file << std::endl;
+        return true;
     }
 
-    std::string output_folder = argv[1];
+    if (task.kind == TaskKind::END_ALL) {
+        return false;
+    }
 
-    // Main loop to communicate with the Script 3
-    while (true) {
-        // Pseudo-code for IPC mechanism to receive messages from Script 3
+    auto found = skier_dispatchers.find(task.mapName);
+    if (found == skier_dispatchers.end()) {
+        std::cout << "Unknown map: " << task.mapName << std::endl;
+        return true;
+    }
+    SkierDispatcherInfo& dispatcher = found->second;
+    if (dispatcher.ended) {
+        std::cout << "Skier dispatcher has already ended: " << task.mapName << std::endl;
+        return true;
+    }
 
-        // If received a map file path
-        spawn_skier_dispatcher(map_file_path);
+    if (task.kind == TaskKind::END_MAP) {
+        end_skier_dispatcher(dispatcher);
+        return true;
+    }
+
+    if (dispatcher.pid == -1) {
+        // Evicted from the cache: bring the map back
+        cache_stats.misses++;
+        launch_skier_dispatcher(task.mapName, dispatcher);
+    } else {
+        cache_stats.hits++;
+        dispatcher.lastUse = ++cache_clock;
+    }
 
+    // Forward the path of the task file to the skier dispatcher of its map,
+    // with the number of the task (for the name of its output file; patches
+    // have no output)
+    std::string message;
+    if (task.kind == TaskKind::PATCH_MAP) {
+        dispatcher.patches.push_back(task_file);
+        message = "0 " + task_file + "\n";
+    } else {
+        message = std::to_string(++dispatcher.tasksSent) + " " + task_file + "\n";
+    }
+    if (write(dispatcher.commandFd, message.c_str(), message.size()) != (ssize_t)message.size()) {
+        // The skier dispatcher is gone (e.g. its map could not be read)
+        end_skier_dispatcher(dispatcher);
+        std::cout << "Skier dispatcher has already ended: " << task.mapName << std::endl;
+    }
+    return true;
+}
+
+void make_room_in_cache(size_t bytes) {
+    if (cache_budget == 0) {
+        return;
+    }
+    while (cache_resident_bytes + bytes > cache_budget) {
+        SkierDispatcherInfo* leastRecent = nullptr;
+        for (auto& [name, dispatcher] : skier_dispatchers) {
+            if (dispatcher.pid != -1 && (leastRecent == nullptr || dispatcher.lastUse < leastRecent->lastUse)) {
+                leastRecent = &dispatcher;
+            }
+        }
+        if (leastRecent == nullptr) {
+            break; // a map larger than the whole budget still gets loaded
+        }
+        evict_skier_dispatcher(*leastRecent);
+    }
+}
+
+void evict_skier_dispatcher(SkierDispatcherInfo& dispatcher) {
+    // The skier dispatcher finishes the tasks it was already sent, then exits.
+    // We don't wait for it here so that the task that needed room isn't delayed.
+    close(dispatcher.commandFd);
+    evicted_dispatchers.push_back(dispatcher.pid);
+    dispatcher.commandFd = -1;
+    dispatcher.pid = -1;
+    cache_resident_bytes -= dispatcher.residentBytes;
+    dispatcher.residentBytes = 0;
+    cache_stats.evictions++;
+}
+
+void reap_evicted_dispatchers(bool block) {
+    for (size_t i = 0; i < evicted_dispatchers.size();) {
+        int status;
+        if (waitpid(evicted_dispatchers[i], &status, block ? 0 : WNOHANG) == 0) {
+            i++;
+        } else {
+            evicted_dispatchers.erase(evicted_dispatchers.begin() + i);
+        }
+    }
+}
+
+void end_skier_dispatcher(SkierDispatcherInfo& dispatcher) {
+    if (dispatcher.ended) {
+        return;
+    }
+    dispatcher.ended = true;
+    if (dispatcher.pid == -1) {
+        return; // not resident
+    }
+    // Closing the pipe tells the skier dispatcher that no more tasks are coming
+    close(dispatcher.commandFd);
+    dispatcher.commandFd = -1;
+
+    int status;
+    waitpid(dispatcher.pid, &status, 0);
+    dispatcher.pid = -1;
+    cache_resident_bytes -= dispatcher.residentBytes;
+    dispatcher.residentBytes = 0;
+}
+
+void end_all_skier_dispatchers() {
+    for (auto& [name, dispatcher] : skier_dispatchers) {
+        end_skier_dispatcher(dispatcher);
+    }
+}
+
+void print_cache_stats() {
+    std::cerr << "Map cache: " << cache_stats.hits << " hits, " << cache_stats.misses << " misses, "
+              << cache_stats.evictions << " evictions, " << cache_resident_bytes << " bytes resident";
+    if (cache_budget != 0) {
+        std::cerr << " (budget " << cache_budget << ")";
+    }
+    std::cerr << std::endl;
+}
+
+bool handle_path(const std::string& command) {
+    std::string path = command;
+    while (!path.empty() && (path.back() == '\n' || path.back() == '\r')) {
+        path.pop_back();
+    }
+
+    if ((path.size() > 4 && path.compare(path.size() - 4, 4, ".map") == 0) || isBinaryMap(path)) {
+        // If received a map file path (text or binary)
+        spawn_skier_dispatcher(path);
+    } else if (path.size() > 5 && path.compare(path.size() - 5, 5, ".task") == 0) {
         // If received a task file path
-        process_task_file(task_file_path);
+        return process_task_file(path);
+    } else if (path == "STATS") {
+        print_cache_stats();
+    }
+    // Anything else is ignored
+    return true;
+}
+
+bool handle_paths(std::vector<std::string>& paths) {
+    std::stable_partition(paths.begin(), paths.end(), [](const std::string& path) {
+        return (path.size() > 4 && path.compare(path.size() - 4, 4, ".map") == 0) || isBinaryMap(path);
+    });
+    for (const auto& path : paths) {
+        if (!handle_path(path)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-        // Check for termination signals or END task to terminate skier dispatchers
+bool start_watching(bool& keepRunning) {
+    // Watch first, so that no file written while we list the folder is missed
+    watch_fd = inotify_init1(IN_NONBLOCK);
+    if (watch_fd == -1 || inotify_add_watch(watch_fd, watch_folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+        perror(("watch " + watch_folder).c_str());
+        return false;
+    }
 
-        // Wait for all child processes to finish before exiting
-        for (pid_t& child : skier_dispatchers) {
-            int status;
-            waitpid(child, &status, 0);
+    std::vector<std::string> paths;
+    DIR* folder = opendir(watch_folder.c_str());
+    if (folder == nullptr) {
+        perror(("open " + watch_folder).c_str());
+        return false;
+    }
+    while (struct dirent* entry = readdir(folder)) {
+        if (entry->d_name[0] != '.') {
+            paths.push_back(watch_folder + "/" + entry->d_name);
         }
     }
+    closedir(folder);
+    std::sort(paths.begin(), paths.end());
+    keepRunning = handle_paths(paths);
+    return true;
+}
 
-    return EXIT_SUCCESS;
+bool handle_watch_events() {
+    // Every event already queued is read, so that the maps among them go first
+    alignas(struct inotify_event) char events[1 << 16];
+    std::vector<std::string> paths;
+    ssize_t length;
+    while ((length = read(watch_fd, events, sizeof(events))) > 0) {
+        for (char* next = events; next < events + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(next);
+            if (event->mask & IN_Q_OVERFLOW) {
+                std::cerr << "Too many files at once in " << watch_folder << ": some were missed" << std::endl;
+            } else if (event->len > 0 && !(event->mask & IN_ISDIR)) {
+                paths.push_back(watch_folder + "/" + event->name);
+            }
+            next += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    if (length == 0 || (length == -1 && errno != EAGAIN && errno != EINTR)) {
+        // The watch folder is gone
+        close(watch_fd);
+        watch_fd = -1;
+    }
+    return handle_paths(paths);
 }
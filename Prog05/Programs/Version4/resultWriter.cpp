@@ -0,0 +1,109 @@
+#include "resultWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <sys/uio.h>
+
+OrderedResultWriter::OrderedResultWriter(int fd, size_t window, bool timed)
+    : fd(fd), window(window < 1 ? 1 : window), timed(timed) {}
+
+void OrderedResultWriter::submit(size_t block, std::string& output, bool complete) {
+    std::unique_lock<std::mutex> lock(mutex);
+    progress.wait(lock, [&]() { return block < nextBlock + window || failed; });
+
+    PendingBlock& pendingBlock = pending[block];
+    if (!output.empty()) {
+        pendingBlock.parts.push_back(std::move(output));
+    }
+    output.clear();
+    pendingBlock.complete = complete;
+
+    // Only the worker of the next block writes; the others leave their output
+    // behind, and it is picked up by that worker before it returns.
+    if (writing || block != nextBlock) {
+        return;
+    }
+    writing = true;
+
+    for (;;) {
+        std::vector<std::string> run;
+        size_t completed = 0;
+        for (auto it = pending.find(nextBlock); it != pending.end() && it->first == nextBlock + completed;) {
+            for (auto& part : it->second.parts) {
+                run.push_back(std::move(part));
+            }
+            it->second.parts.clear();
+            if (!it->second.complete) {
+                break;
+            }
+            it = pending.erase(it);
+            completed++;
+        }
+        if (run.empty() && completed == 0) {
+            break;
+        }
+
+        lock.unlock();
+        std::vector<struct iovec> buffers;
+        buffers.reserve(run.size());
+        size_t runBytes = 0;
+        for (auto& part : run) {
+            buffers.push_back({part.data(), part.size()});
+            runBytes += part.size();
+        }
+        auto begin = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+        bool ok = failed || writeBuffers(fd, buffers);
+        lock.lock();
+        if (timed) {
+            writeTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        }
+
+        if (!ok) {
+            failed = true;
+        } else {
+            written += runBytes;
+        }
+        nextBlock += completed;
+        progress.notify_all();
+    }
+    writing = false;
+}
+
+bool OrderedResultWriter::finish() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !failed && pending.empty();
+}
+
+size_t OrderedResultWriter::bytesWritten() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return written;
+}
+
+double OrderedResultWriter::writeMilliseconds() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return writeTime;
+}
+
+bool writeBuffers(int fd, std::vector<struct iovec>& buffers) {
+    size_t first = 0;
+    while (first < buffers.size()) {
+        int count = (int)std::min(buffers.size() - first, (size_t)IOV_MAX);
+        ssize_t written = writev(fd, buffers.data() + first, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        // Skip what was written, which may end in the middle of a buffer
+        while (first < buffers.size() && (size_t)written >= buffers[first].iov_len) {
+            written -= buffers[first].iov_len;
+            first++;
+        }
+        if (first < buffers.size()) {
+            buffers[first].iov_base = static_cast<char*>(buffers[first].iov_base) + written;
+            buffers[first].iov_len -= written;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef RESULT_WRITER_H
+#define RESULT_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+
+// Writes the output of a task in start-point order while its skiers are
+// still running.
+//
+// The start points of a task are cut into numbered blocks. A worker formats
+// a block into its own buffer and hands the buffer over to the writer, which
+// writes the longest run of blocks it has from the next one expected, with a
+// single writev per run and no copy of the buffers. A worker may also hand
+// over part of a block before it is complete (a long TRACE output): that part
+// is written right away if its block is the next one. Workers more than
+// `window` blocks ahead of the writer wait, so that the buffered output stays
+// bounded whatever the size of the task.
+class OrderedResultWriter {
+public:
+    // With `timed`, the time spent writing is measured (for --stats)
+    OrderedResultWriter(int fd, size_t window, bool timed = false);
+
+    // Hand over output of a block (its buffer is taken over, and left empty).
+    // `complete` tells that this was the last part of the block.
+    void submit(size_t block, std::string& output, bool complete);
+
+    // True if every block has been written
+    bool finish();
+
+    // Bytes written so far
+    size_t bytesWritten();
+
+    // Time spent in writev so far, in milliseconds (0 unless timed)
+    double writeMilliseconds();
+
+private:
+    struct PendingBlock {
+        std::vector<std::string> parts;
+        bool complete = false;
+    };
+
+    int fd;
+    size_t window;
+    std::mutex mutex;
+    std::condition_variable progress;
+    std::map<size_t, PendingBlock> pending;
+    size_t nextBlock = 0;   // first block not completely written
+    bool writing = false;   // a worker is writing on behalf of the others
+    bool failed = false;
+    size_t written = 0;
+    bool timed;
+    double writeTime = 0.0; // ms
+};
+
+// Write a list of buffers with writev, resuming after partial writes.
+// The buffers are consumed. Returns false on a write error.
+bool writeBuffers(int fd, std::vector<struct iovec>& buffers);
+
+#endif // RESULT_WRITER_H
@@ -0,0 +1,335 @@
+#include "sharedMap.h"
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t SHARED_MAP_MAGIC = 0x50354d50; // "P5MP"
+const uint32_t SHARED_MAP_VERSION = 2;
+// How long a segment that is not ready, and not locked by a publisher, is
+// given before it is taken for the leftover of a crashed one (in microseconds):
+// it covers the gap between the publisher creating the segment and locking it.
+const useconds_t SHARED_MAP_PUBLISH_GRACE = 10000;
+
+// Header at the start of a shared map segment. The elevations follow, starting
+// on the next page so that they can be mapped read-only on their own.
+//
+// Liveness is kept by flock on the segment rather than in the header, so that
+// the kernel releases it when a process dies: the publisher holds an exclusive
+// lock until the segment is ready, and every attached process (publisher
+// included) holds a shared lock for as long as it is attached.
+struct SharedMapHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> ready;   // set once the elevations have been written
+    int32_t rows;
+    int32_t cols;
+    uint64_t dataOffset;           // where the elevations start
+    // Identity of the map file the elevations were read from
+    uint64_t sourceDevice;
+    uint64_t sourceInode;
+    int64_t sourceSize;
+    int64_t sourceMtime;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the ready flag must work across processes");
+
+// A process' attachment to a shared map segment. Destroyed when the last
+// ElevationMap using it goes away, at which point the process detaches.
+struct SharedMapAttachment {
+    std::string name;
+    int fd = -1;                   // holds the shared lock
+    SharedMapHeader* header = nullptr;
+    size_t headerLength = 0;
+    void* data = nullptr;
+    size_t dataLength = 0;
+
+    ~SharedMapAttachment();
+};
+
+// Stable (across processes) hash of the map path
+uint64_t fnv1a(const std::string& text) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Size of the header, rounded up to a page
+size_t headerLength() {
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    return (sizeof(SharedMapHeader) + pageSize - 1) / pageSize * pageSize;
+}
+
+// Remove the segment name, unless it already names another segment than the
+// one open on fd (removed and published again by someone else)
+void unlinkSegment(const std::string& name, int fd) {
+    struct stat ours, named;
+    int other = shm_open(name.c_str(), O_RDONLY, 0600);
+    if (other == -1) {
+        return;
+    }
+    if (fstat(fd, &ours) == 0 && fstat(other, &named) == 0 && ours.st_dev == named.st_dev && ours.st_ino == named.st_ino) {
+        shm_unlink(name.c_str());
+    }
+    close(other);
+}
+
+// Blocking flock that is not cut short by a signal
+int lockSegment(int fd, int operation) {
+    int result;
+    do {
+        result = flock(fd, operation);
+    } while (result == -1 && errno == EINTR);
+    return result;
+}
+
+// True if no live process is attached to (or publishing) the segment open on
+// fd. On success the caller holds the exclusive lock until it closes fd.
+bool unused(int fd) {
+    return flock(fd, LOCK_EX | LOCK_NB) == 0;
+}
+
+SharedMapAttachment::~SharedMapAttachment() {
+    if (data != nullptr) {
+        munmap(data, dataLength);
+    }
+    if (header != nullptr) {
+        munmap(header, headerLength);
+    }
+    if (fd != -1) {
+        // The last process out removes the segment
+        if (unused(fd)) {
+            unlinkSegment(name, fd);
+        }
+        close(fd);
+    }
+}
+
+bool sameSource(const SharedMapHeader* header, const struct stat& source) {
+    return header->sourceDevice == (uint64_t)source.st_dev && header->sourceInode == (uint64_t)source.st_ino
+        && header->sourceSize == (int64_t)source.st_size && header->sourceMtime == (int64_t)source.st_mtime;
+}
+
+// Map the elevations of a segment read-only and hand them to the ElevationMap
+void useAttachment(std::shared_ptr<SharedMapAttachment> attachment, ElevationMap& map) {
+    map.rows = attachment->header->rows;
+    map.cols = attachment->header->cols;
+    map.storage.clear();
+    map.storage.shrink_to_fit();
+    map.tileOffsets.clear();
+    map.cells = static_cast<const float*>(attachment->data);
+    map.backing = std::move(attachment);
+}
+
+// Create the segment for a map we were the first to ask for.
+// Returns 1 on success, 0 if the map file cannot be read, -1 on a shared memory error.
+int publish(int fd, const std::string& name, const std::string& mapFilePath, const struct stat& source, ElevationMap& map) {
+    // Attachers wait on this lock; if we die before the segment is ready, the
+    // kernel drops it and they find the segment stale
+    if (lockSegment(fd, LOCK_EX) == -1) {
+        shm_unlink(name.c_str());
+        close(fd);
+        return readMap(mapFilePath, map) ? -1 : 0;
+    }
+
+    ElevationMap loaded;
+    if (!readMap(mapFilePath, loaded)) {
+        shm_unlink(name.c_str());
+        close(fd);
+        return 0;
+    }
+
+    auto attachment = std::make_shared<SharedMapAttachment>();
+    attachment->name = name;
+    attachment->headerLength = headerLength();
+    attachment->dataLength = loaded.storage.size() * sizeof(float);
+
+    if (ftruncate(fd, (off_t)(attachment->headerLength + attachment->dataLength)) == -1) {
+        shm_unlink(name.c_str());
+        close(fd);
+        map = std::move(loaded);
+        return -1;
+    }
+
+    void* header = mmap(nullptr, attachment->headerLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    void* data = mmap(nullptr, attachment->dataLength, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)attachment->headerLength);
+    if (header == MAP_FAILED || data == MAP_FAILED) {
+        if (header != MAP_FAILED) munmap(header, attachment->headerLength);
+        if (data != MAP_FAILED) munmap(data, attachment->dataLength);
+        shm_unlink(name.c_str());
+        close(fd);
+        map = std::move(loaded);
+        return -1;
+    }
+
+    memcpy(data, loaded.storage.data(), attachment->dataLength);
+    // From now on nobody writes the elevations, including us
+    mprotect(data, attachment->dataLength, PROT_READ);
+
+    SharedMapHeader* sharedHeader = new (header) SharedMapHeader;
+    sharedHeader->magic = SHARED_MAP_MAGIC;
+    sharedHeader->version = SHARED_MAP_VERSION;
+    sharedHeader->rows = loaded.rows;
+    sharedHeader->cols = loaded.cols;
+    sharedHeader->dataOffset = attachment->headerLength;
+    sharedHeader->sourceDevice = (uint64_t)source.st_dev;
+    sharedHeader->sourceInode = (uint64_t)source.st_ino;
+    sharedHeader->sourceSize = (int64_t)source.st_size;
+    sharedHeader->sourceMtime = (int64_t)source.st_mtime;
+    sharedHeader->ready.store(1, std::memory_order_release);
+
+    // Let the attachers in, staying attached ourselves
+    lockSegment(fd, LOCK_SH);
+    attachment->fd = fd;
+    attachment->header = sharedHeader;
+    attachment->data = data;
+    useAttachment(std::move(attachment), map);
+    return 1;
+}
+
+// Attach to the segment published by another process.
+// Returns 1 on success, 0 if the segment is stale or vanished (worth retrying
+// the publication), -1 if we should give up on shared memory for this map.
+int attach(const std::string& name, const struct stat& source, ElevationMap& map) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd == -1) {
+        return (errno == ENOENT) ? 0 : -1;
+    }
+
+    // Blocks for as long as the publisher is writing the segment (and is alive).
+    // A segment that is still not ready once we get the lock was either just
+    // created, its publisher about to lock it, or left by a publisher that
+    // died: look again after a grace period to tell them apart.
+    const size_t length = headerLength();
+    SharedMapHeader* header = nullptr;
+    for (int look = 0; look < 2 && header == nullptr; look++) {
+        if (look > 0) {
+            flock(fd, LOCK_UN);
+            usleep(SHARED_MAP_PUBLISH_GRACE);
+        }
+        struct stat segment;
+        if (lockSegment(fd, LOCK_SH) == -1 || fstat(fd, &segment) == -1) {
+            close(fd);
+            return -1;
+        }
+        if ((size_t)segment.st_size < length) {
+            continue;
+        }
+        auto mapped = static_cast<SharedMapHeader*>(mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        if (mapped->ready.load(std::memory_order_acquire) == 0) {
+            munmap(mapped, length);
+            continue;
+        }
+        header = mapped;
+    }
+
+    if (header == nullptr) {
+        // Left behind by a publisher that died: remove it, unless someone is on it
+        if (unused(fd)) {
+            unlinkSegment(name, fd);
+        }
+        close(fd);
+        return 0;
+    }
+
+    if (header->magic != SHARED_MAP_MAGIC || header->version != SHARED_MAP_VERSION) {
+        munmap(header, length);
+        close(fd);
+        return -1;
+    }
+
+    if (!sameSource(header, source)) {
+        // Published from an older version of the map file: remove it if nobody uses it anymore
+        munmap(header, length);
+        flock(fd, LOCK_UN);
+        bool stale = unused(fd);
+        if (stale) {
+            unlinkSegment(name, fd);
+        }
+        close(fd);
+        return stale ? 0 : -1;
+    }
+
+    auto attachment = std::make_shared<SharedMapAttachment>();
+    attachment->name = name;
+    attachment->fd = fd;
+    attachment->header = header;
+    attachment->headerLength = length;
+    attachment->dataLength = (size_t)header->rows * header->cols * sizeof(float);
+    void* data = mmap(nullptr, attachment->dataLength, PROT_READ, MAP_SHARED, fd, (off_t)header->dataOffset);
+    if (data == MAP_FAILED) {
+        return -1; // the attachment detaches on its way out
+    }
+    attachment->data = data;
+    useAttachment(std::move(attachment), map);
+    return 1;
+}
+
+} // namespace
+
+std::string sharedMapSegmentName(const std::string& mapFilePath) {
+    char* resolved = realpath(mapFilePath.c_str(), nullptr);
+    std::string fullPath = resolved ? resolved : mapFilePath;
+    free(resolved);
+
+    // Segment names are a single path component: keep it short and tame
+    std::string name = "/prog05_";
+    for (char c : extractMapName(mapFilePath).substr(0, 64)) {
+        name += (isalnum((unsigned char)c) || c == '_' || c == '-') ? c : '_';
+    }
+    char hash[32];
+    snprintf(hash, sizeof(hash), "_%016llx", (unsigned long long)fnv1a(fullPath));
+    return name + hash;
+}
+
+bool loadSharedMap(const std::string& mapFilePath, ElevationMap& map) {
+    struct stat source;
+    if (stat(mapFilePath.c_str(), &source) != 0) {
+        return false;
+    }
+    const std::string name = sharedMapSegmentName(mapFilePath);
+
+    // A few rounds in case the segment we find is being removed by its last user
+    for (int attempt = 0; attempt < 3; attempt++) {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd != -1) {
+            int published = publish(fd, name, mapFilePath, source, map);
+            if (published >= 0) {
+                return published == 1;
+            }
+            return true; // map loaded, just not shared
+        }
+        if (errno != EEXIST) {
+            break;
+        }
+
+        int attached = attach(name, source, map);
+        if (attached == 1) {
+            return true;
+        }
+        if (attached == -1) {
+            break;
+        }
+    }
+
+    // Shared memory not available for this map: keep a private copy
+    return readMap(mapFilePath, map);
+}
@@ -0,0 +1,30 @@
+#ifndef SHARED_MAP_H
+#define SHARED_MAP_H
+
+#include <string>
+
+#include "elevationMap.h"
+
+// Maps published in POSIX shared memory.
+//
+// When several skier dispatcher processes serve the same map (several general
+// dispatchers on one host, or a dispatcher relaunched for a map), the first one
+// to load the map publishes its elevations in a named shared memory segment,
+// and the others attach to that segment (read-only) instead of reading and
+// holding their own copy. The segment starts with a header giving the map
+// size and the identity of the map file it was read from. Every attached
+// process holds a shared flock on the segment, so the kernel keeps track of
+// who is attached even through crashes: the last process to detach removes
+// it, and a segment whose publisher died before it was ready is removed by
+// the next process that asks for the map.
+
+// Load a map through its shared memory segment: attach to the segment if a
+// process has already published this map, publish it otherwise. Falls back to
+// a private copy (like readMap) if shared memory is unavailable. Returns false
+// only if the map file itself cannot be read.
+bool loadSharedMap(const std::string& mapFilePath, ElevationMap& map);
+
+// Name of the shared memory segment used for a map file
+std::string sharedMapSegmentName(const std::string& mapFilePath);
+
+#endif // SHARED_MAP_H
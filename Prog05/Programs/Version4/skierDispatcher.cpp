@@ -0,0 +1,740 @@
+#include "skierDispatcher.h"
+#include "sharedMap.h"
+#include "resultWriter.h"
+#include "pathMemo.h"
+#include "binaryMap.h"
+#include "batchDescent.h"
+#include "basinRaster.h"
+#include "memoryPlacement.h"
+#include "binaryOutput.h"
+
+#include <iostream>
+#include <fstream>
+#include <atomic>
+#include <charconv>
+#include <cerrno>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Start points handed to a worker at a time, and blocks a worker may run ahead of the writer
+const size_t SKIER_BLOCK_SIZE = 256;
+const size_t BLOCKS_AHEAD_PER_WORKER = 4;
+// Output of an unfinished block passed on to the writer once it gets this large
+const size_t STREAMING_FLUSH_SIZE = 1 << 16;
+// Blocks of start points a task runs in each of its turns, per unit of priority
+const size_t BLOCKS_PER_TURN = 64;
+// A task on a map without an index memoizes the paths of its skiers if it has
+// at least one skier per this many cells (the memo takes 9 bytes per cell)
+const size_t PATH_MEMO_CELLS_PER_SKIER = 256;
+
+// Skiers of a task, counted by the workers (--stats only)
+struct TaskCounters {
+    std::atomic<uint64_t> skiers{0};
+    std::atomic<uint64_t> steps{0};
+    std::atomic<int64_t> maxPathLength{0};
+};
+
+// What the workers of a task share
+struct TaskContext {
+    const ResidentMap& map;
+    const Task& task;
+    PathMemo& memo;
+    SharedTails* sharedTails; // compact TRACE output only
+    bool batch;               // NO_TRACE skiers of a block go down together (batchDescent)
+    bool binary;              // binary output (binaryOutput.h)
+    TaskCounters* counters;   // --stats only
+};
+
+// A task run a turn at a time, a few blocks of its skiers per turn, so that
+// the skier dispatcher can take turns between the tasks it has been sent
+class TaskRun {
+public:
+    TaskRun(const ResidentMap& map, const Task& task, const SkierDispatcherOptions& options, TaskStats* stats);
+
+    // Open the output file and write its first lines. Returns false if it could not be written.
+    bool start(const std::string& outputFilePath);
+
+    // Run the next blocks of skiers, at most maxBlocks of them. Returns true once every block has run.
+    bool runTurn(size_t maxBlocks);
+
+    // Close the output file and fill in the statistics. Returns false if the output could not be written.
+    bool finish();
+
+    // Time spent running the task so far, in milliseconds
+    double runMilliseconds() const { return runMs; }
+
+private:
+    const ResidentMap& map;
+    const Task& task;
+    TaskStats* stats;
+    bool compact;
+    bool memoize; // paths are memoized (with at least one skier per PATH_MEMO_CELLS_PER_SKIER cells)
+    int outFd = -1;
+    size_t headerBytes = 0;
+    size_t numBlocks;
+    size_t numWorkers;
+    size_t claimedBlocks = 0; // compact TRACE only: blocks whose paths have been claimed
+    size_t nextBlock = 0;     // first block not run yet
+    double runMs = 0.0;
+    PathMemo memo;
+    std::unique_ptr<SharedTails> sharedTails;
+    TaskCounters counters;
+    TaskContext context;
+    std::unique_ptr<OrderedResultWriter> writer;
+};
+
+// A task sent to a skier dispatcher, from its command to the end of its run
+struct ScheduledTask {
+    int taskNumber = 0;
+    std::string taskFilePath;
+    Task task;
+    TaskStats stats;
+    std::chrono::steady_clock::time_point received; // once parsed
+    std::unique_ptr<TaskRun> run;                   // once started
+};
+
+// Read the commands available on commandFd into `commands`, waiting for some if `wait`.
+// `pending` keeps the start of a command not received in full yet.
+// Returns false once the general dispatcher has closed commandFd.
+static bool readCommands(int commandFd, bool wait, std::string& pending, std::vector<std::string>& commands);
+// Run work(block) for blocks first to end - 1, on numWorkers threads taking the next block in turn
+static void forEachBlock(size_t first, size_t end, size_t numWorkers, const std::function<void(size_t)>& work);
+// Record the path of one skier in the shared tails of its task
+static void claimPath(TaskContext& context, size_t skier);
+// Run the skiers of a block through batchDescent
+static void batchBlock(TaskContext& context, size_t first, size_t end, int64_t* ends, int64_t* lengths);
+// Append the result of one skier to a buffer, exactly as the Version 3 skiers wrote it.
+// The end of its path and its length are looked up, unless given (end >= 0).
+// Returns the length of the path (0 for an invalid start point).
+static int64_t appendSkierResult(TaskContext& context, size_t skier, std::string& output, int64_t end = -1,
+                                 int64_t pathLength = 0);
+// Append the record of one skier to a buffer, in the binary output format (same arguments as appendSkierResult)
+static int64_t appendSkierRecord(TaskContext& context, size_t skier, std::string& output, int64_t end, int64_t pathLength);
+// Milliseconds since a given time
+static double millisecondsSince(std::chrono::steady_clock::time_point begin);
+// Print the statistics of a task on the standard error
+static void printTaskStats(const std::string& mapName, const std::string& taskFilePath, const TaskStats& stats,
+                           StatsFormat format);
+// Display an error in place of the map output
+static void show_error(const std::string& outputFilePath, const std::string& Output_String);
+// Back the elevations and the index of a resident map with huge pages (false if the kernel refused)
+static bool placeOnHugePages(const ResidentMap& map);
+
+int runSkierDispatcher(const std::string& mapFilePath, const std::string& outputFolderPath, int commandFd,
+                       const SkierDispatcherOptions& options) {
+    const std::string mapName = extractMapName(mapFilePath);
+
+    // The map is read once, and stays resident (with its index) for every task of this dispatcher.
+    // A binary map is mapped instead, and only its descent field is computed.
+    ResidentMap map;
+    TaskStats loadStats; // reported with the first task
+    // Only the resident map and its index are interleaved, and allocated on huge pages;
+    // the buffers of the tasks stay local
+    const bool interleaved = options.numaInterleave && numaNodes() > 1 && interleaveAllocations(true);
+    hugePageAllocations(options.hugePages);
+    auto phaseStart = std::chrono::steady_clock::now();
+    bool loaded;
+    if (isBinaryMap(mapFilePath)) {
+        loaded = openBinaryMap(mapFilePath, map.elevations);
+        loadStats.mapMs = millisecondsSince(phaseStart);
+        phaseStart = std::chrono::steady_clock::now();
+        loaded = loaded && loadDescentField(map.elevations, mapFilePath, map.field);
+        loadStats.indexMs = millisecondsSince(phaseStart);
+        map.outOfCore = true;
+    } else {
+        loaded = options.sharedMaps ? loadSharedMap(mapFilePath, map.elevations) : readMap(mapFilePath, map.elevations);
+    }
+    if (!loaded) {
+        show_error(outputFolderPath + "/" + mapName + ".txt", "File not found");
+        close(commandFd);
+        return 12;
+    }
+    if (options.tiledMaps && !options.sharedMaps && !map.outOfCore) {
+        tileMap(map.elevations);
+    }
+    if (options.fixedPoint && !options.sharedMaps && !map.outOfCore && !compactMap(map.elevations)) {
+        std::cerr << "Map " << mapName << " does not fit in fixed point, kept in floating point" << std::endl;
+    }
+    if (!map.outOfCore) {
+        loadStats.mapMs = millisecondsSince(phaseStart);
+    }
+    if (options.useIndex && !map.outOfCore) {
+        phaseStart = std::chrono::steady_clock::now();
+        buildDescentIndex(map.elevations, map.index);
+        map.indexed = true;
+        loadStats.indexMs = millisecondsSince(phaseStart);
+    }
+    if (interleaved) {
+        interleaveAllocations(false);
+    }
+    hugePageAllocations(false);
+    if (options.hugePages && !placeOnHugePages(map)) {
+        std::cerr << "Map " << mapName << " kept on small pages: transparent huge pages are not available" << std::endl;
+    }
+
+    // Each command is "<task number> <task file path>". Each task file gets its
+    // own output file, so that several tasks on the same map don't overwrite
+    // each other: <map>.txt for the first one, then <map>_2.txt, ...
+    //
+    // Commands keep being read while tasks run, and the skier tasks under way
+    // take turns: a turn runs BLOCKS_PER_TURN blocks of skiers per unit of
+    // priority of its task, so a small task sent behind a large one waits for
+    // a turn of it rather than for all of it. A patch waits for the tasks under
+    // way, and the tasks sent after it wait for the patch, so every task sees
+    // the map as it was when the task was sent.
+    std::deque<std::unique_ptr<ScheduledTask>> queued;  // not started, in the order they were sent
+    std::deque<std::unique_ptr<ScheduledTask>> running; // the one to take the next turn first
+    std::string pendingCommand;
+    bool reading = true;
+    while (reading || !queued.empty() || !running.empty()) {
+        if (reading) {
+            std::vector<std::string> commands;
+            reading = readCommands(commandFd, queued.empty() && running.empty(), pendingCommand, commands);
+            for (const std::string& command : commands) {
+                size_t space = command.find(' ');
+                if (space == std::string::npos) {
+                    continue;
+                }
+                auto scheduled = std::make_unique<ScheduledTask>();
+                scheduled->taskNumber = atoi(command.c_str());
+                scheduled->taskFilePath = command.substr(space + 1);
+
+                phaseStart = std::chrono::steady_clock::now();
+                Task& task = scheduled->task;
+                bool parsed = parseTaskFile(scheduled->taskFilePath, task);
+                if (!parsed || (task.kind != TaskKind::RUN_SKIERS && task.kind != TaskKind::PATCH_MAP &&
+                                task.kind != TaskKind::EXPORT_BASINS)) {
+                    std::cerr << "Invalid task file: " << scheduled->taskFilePath << std::endl;
+                    continue;
+                }
+                if (task.kind == TaskKind::RUN_SKIERS) {
+                    scheduled->stats = loadStats;
+                    scheduled->stats.parseMs = millisecondsSince(phaseStart);
+                    loadStats = TaskStats();
+                }
+                scheduled->received = std::chrono::steady_clock::now();
+                queued.push_back(std::move(scheduled));
+            }
+        }
+
+        // Start the tasks that may start
+        while (!queued.empty()) {
+            ScheduledTask& scheduled = *queued.front();
+            const Task& task = scheduled.task;
+            if (task.kind == TaskKind::PATCH_MAP) {
+                if (!running.empty()) {
+                    break;
+                }
+                if (!applyPatch(map, task.patch)) {
+                    std::cerr << "Invalid patch for map " << mapName << ": " << scheduled.taskFilePath << std::endl;
+                }
+                queued.pop_front();
+                continue;
+            }
+
+            std::string outputPathPrefix = outputFolderPath + "/" + mapName;
+            if (scheduled.taskNumber > 1) {
+                outputPathPrefix += "_" + std::to_string(scheduled.taskNumber);
+            }
+            if (task.kind == TaskKind::EXPORT_BASINS) {
+                if (!exportBasins(map, outputPathPrefix, task.basinImage)) {
+                    std::cerr << "Failed to export the basins of map " << mapName << std::endl;
+                }
+                queued.pop_front();
+                continue;
+            }
+            const std::string outputFilePath = outputPathPrefix + (options.binaryOutput ? ".bout" : ".txt");
+            const bool measured = options.stats != StatsFormat::NONE;
+            scheduled.run = std::make_unique<TaskRun>(map, task, options, measured ? &scheduled.stats : nullptr);
+            if (scheduled.run->start(outputFilePath)) {
+                running.push_back(std::move(queued.front()));
+            } else {
+                std::cerr << "Failed to write output file " << outputFilePath << std::endl;
+            }
+            queued.pop_front();
+        }
+        if (running.empty()) {
+            continue;
+        }
+
+        // One turn of the next task under way
+        std::unique_ptr<ScheduledTask> scheduled = std::move(running.front());
+        running.pop_front();
+        if (!scheduled->run->runTurn(BLOCKS_PER_TURN * scheduled->task.priority)) {
+            running.push_back(std::move(scheduled));
+            continue;
+        }
+        if (!scheduled->run->finish()) {
+            std::cerr << "Failed to write output file for " << scheduled->taskFilePath << std::endl;
+        }
+        if (options.stats != StatsFormat::NONE) {
+            scheduled->stats.queueMs = millisecondsSince(scheduled->received) - scheduled->run->runMilliseconds();
+            printTaskStats(mapName, scheduled->taskFilePath, scheduled->stats, options.stats);
+        }
+    }
+
+    close(commandFd);
+    return 0;
+}
+
+size_t residentMapBytes(const std::string& mapFilePath, int rows, int cols, const SkierDispatcherOptions& options) {
+    if (isBinaryMap(mapFilePath)) {
+        // The map and its field are paged in and out by the kernel
+        return (size_t)((rows + MAP_TILE_MASK) >> MAP_TILE_SHIFT) * ((cols + MAP_TILE_MASK) >> MAP_TILE_SHIFT) * 2 * sizeof(size_t);
+    }
+    size_t bytes = (options.tiledMaps && !options.sharedMaps) ? tiledMapBytes(rows, cols) : (size_t)rows * cols * sizeof(float);
+    if (options.fixedPoint && !options.sharedMaps) {
+        bytes /= 2; // as long as the map fits in fixed point
+    }
+    if (options.useIndex) {
+        bytes += descentIndexBytes(rows, cols);
+    }
+    return bytes;
+}
+
+bool applyPatch(ResidentMap& map, const MapPatch& patch) {
+    // A binary map is mapped read-only (and too large to be copied)
+    if (map.outOfCore || patch.row < 0 || patch.col < 0 || patch.row + patch.rows > map.elevations.rows ||
+        patch.col + patch.cols > map.elevations.cols || patch.elevations.size() != (size_t)patch.rows * patch.cols) {
+        return false;
+    }
+    setElevations(map.elevations, patch.row, patch.col, patch.rows, patch.cols, patch.elevations.data());
+    if (map.indexed) {
+        updateDescentIndex(map.elevations, map.index, patch.row, patch.col, patch.rows, patch.cols);
+    }
+    return true;
+}
+
+bool exportBasins(const ResidentMap& map, const std::string& outputPathPrefix, bool image) {
+    if (map.outOfCore) {
+        return false;
+    }
+    if (map.indexed) {
+        return writeBasinRasters(map.index, outputPathPrefix, image);
+    }
+    DescentIndex index;
+    buildDescentIndex(map.elevations, index);
+    return writeBasinRasters(index, outputPathPrefix, image);
+}
+
+bool runTask(const ResidentMap& map, const Task& task, const std::string& outputFilePath,
+             const SkierDispatcherOptions& options, TaskStats* stats) {
+    TaskRun run(map, task, options, stats);
+    if (!run.start(outputFilePath)) {
+        return false;
+    }
+    while (!run.runTurn(SIZE_MAX)) {
+    }
+    return run.finish();
+}
+
+// The skiers of a task share the resident map (read-only), so they run as
+// threads of the dispatcher rather than forked processes. Each worker takes
+// the next block of start points, formats it into its own buffer and hands
+// it to the writer, which puts the blocks back in order in the output file.
+TaskRun::TaskRun(const ResidentMap& map, const Task& task, const SkierDispatcherOptions& options, TaskStats* stats)
+    : map(map),
+      task(task),
+      stats(stats),
+      // The compact form needs 8 bytes per cell of the map, which a binary map can't afford.
+      // Binary output has no compact form: its paths take 3 bits a point as they are.
+      compact(task.traceMode && options.compactTrace && !map.outOfCore && !options.binaryOutput),
+      memoize(task.points.size() * PATH_MEMO_CELLS_PER_SKIER >= (size_t)map.elevations.rows * map.elevations.cols),
+      numBlocks((task.points.size() + SKIER_BLOCK_SIZE - 1) / SKIER_BLOCK_SIZE),
+      numWorkers(std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), numBlocks))),
+      memo(map.elevations, map.indexed ? &map.index : nullptr, map.outOfCore ? &map.field : nullptr, memoize),
+      sharedTails(compact ? std::make_unique<SharedTails>((size_t)map.elevations.rows * map.elevations.cols) : nullptr),
+      // With nothing known of the map beforehand, and no trace to write, the
+      // skiers are better off searching side by side
+      context{map, task, memo, sharedTails.get(), !task.traceMode && !map.indexed && !map.outOfCore && !memoize,
+              options.binaryOutput, stats != nullptr ? &counters : nullptr} {
+}
+
+bool TaskRun::start(const std::string& outputFilePath) {
+    const auto turnStart = std::chrono::steady_clock::now();
+    outFd = open(outputFilePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (outFd == -1) {
+        return false;
+    }
+
+    // Write TRACE (COMPACT_TRACE) or NO_TRACE as the first line, then the number of skiers
+    std::string header;
+    if (context.binary) {
+        appendBinaryOutputHeader(header, task.traceMode, task.points.size());
+    } else {
+        header = std::string(compact ? "COMPACT_TRACE" : task.traceMode ? "TRACE" : "NO_TRACE") + "\n" +
+                 std::to_string(task.points.size()) + "\n";
+    }
+    headerBytes = header.size();
+    std::vector<struct iovec> headerBuffer = {{header.data(), header.size()}};
+    if (!writeBuffers(outFd, headerBuffer)) {
+        close(outFd);
+        outFd = -1;
+        return false;
+    }
+    writer = std::make_unique<OrderedResultWriter>(outFd, numWorkers * BLOCKS_AHEAD_PER_WORKER, stats != nullptr);
+    runMs += millisecondsSince(turnStart);
+    return true;
+}
+
+bool TaskRun::runTurn(size_t maxBlocks) {
+    const auto turnStart = std::chrono::steady_clock::now();
+    const size_t numSkiers = task.points.size();
+
+    // The compact output of a skier depends on the skiers before it, so all the
+    // paths are claimed before any of them is written
+    if (compact && claimedBlocks < numBlocks) {
+        size_t end = maxBlocks < numBlocks - claimedBlocks ? claimedBlocks + maxBlocks : numBlocks;
+        forEachBlock(claimedBlocks, end, numWorkers, [this, numSkiers](size_t block) {
+            size_t last = std::min(numSkiers, (block + 1) * SKIER_BLOCK_SIZE);
+            for (size_t i = block * SKIER_BLOCK_SIZE; i < last; i++) {
+                claimPath(context, i);
+            }
+        });
+        claimedBlocks = end;
+        runMs += millisecondsSince(turnStart);
+        return false;
+    }
+
+    size_t end = maxBlocks < numBlocks - nextBlock ? nextBlock + maxBlocks : numBlocks;
+    OrderedResultWriter& writer = *this->writer;
+    forEachBlock(nextBlock, end, numWorkers, [this, &writer, numSkiers](size_t block) {
+        std::string output;
+        size_t first = block * SKIER_BLOCK_SIZE;
+        size_t end = std::min(numSkiers, first + SKIER_BLOCK_SIZE);
+        int64_t pathEnds[SKIER_BLOCK_SIZE], pathLengths[SKIER_BLOCK_SIZE];
+        if (context.batch) {
+            batchBlock(context, first, end, pathEnds, pathLengths);
+        }
+        uint64_t skiers = 0, steps = 0;
+        int64_t maxPathLength = 0;
+        for (size_t i = first; i < end; i++) {
+            int64_t pathLength;
+            if (context.batch) {
+                pathLength = appendSkierResult(context, i, output, pathEnds[i - first], pathLengths[i - first]);
+            } else {
+                pathLength = appendSkierResult(context, i, output);
+            }
+            if (context.counters != nullptr && pathLength > 0) {
+                skiers++;
+                steps += pathLength - 1;
+                maxPathLength = std::max(maxPathLength, pathLength);
+            }
+            if (output.size() >= STREAMING_FLUSH_SIZE && i + 1 < end) {
+                writer.submit(block, output, false);
+            }
+        }
+        if (context.counters != nullptr) {
+            context.counters->skiers += skiers;
+            context.counters->steps += steps;
+            int64_t knownMax = context.counters->maxPathLength.load();
+            while (maxPathLength > knownMax && !context.counters->maxPathLength.compare_exchange_weak(knownMax, maxPathLength)) {
+            }
+        }
+        writer.submit(block, output, true);
+    });
+    nextBlock = end;
+    runMs += millisecondsSince(turnStart);
+    return nextBlock == numBlocks;
+}
+
+bool TaskRun::finish() {
+    const auto turnStart = std::chrono::steady_clock::now();
+    bool ok = writer->finish();
+    ok = close(outFd) == 0 && ok;
+    outFd = -1;
+    runMs += millisecondsSince(turnStart);
+    if (stats != nullptr) {
+        stats->outputMs = writer->writeMilliseconds();
+        stats->queryMs = runMs - stats->outputMs;
+        stats->skiers = counters.skiers;
+        stats->steps = counters.steps;
+        stats->maxPathLength = counters.maxPathLength;
+        stats->bytesWritten = headerBytes + writer->bytesWritten();
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            stats->peakRssKb = usage.ru_maxrss;
+        }
+        stats->hugePagesKb = hugePagesKb();
+    }
+    return ok;
+}
+
+static bool readCommands(int commandFd, bool wait, std::string& pending, std::vector<std::string>& commands) {
+    struct pollfd command = {commandFd, POLLIN, 0};
+    if (poll(&command, 1, wait ? -1 : 0) <= 0) {
+        return true;
+    }
+    char buffer[4096];
+    ssize_t bytesRead = read(commandFd, buffer, sizeof(buffer));
+    if (bytesRead < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    pending.append(buffer, bytesRead);
+    // The last command may come without its newline
+    if (bytesRead == 0 && !pending.empty()) {
+        pending += '\n';
+    }
+    size_t newline;
+    while ((newline = pending.find('\n')) != std::string::npos) {
+        std::string line = pending.substr(0, newline);
+        pending.erase(0, newline + 1);
+        while (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        commands.push_back(line);
+    }
+    return bytesRead > 0;
+}
+
+static void forEachBlock(size_t first, size_t end, size_t numWorkers, const std::function<void(size_t)>& work) {
+    std::atomic<size_t> nextBlock{first};
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < numWorkers && first + w < end; w++) {
+        workers.emplace_back([&work, &nextBlock, end]() {
+            size_t block;
+            while ((block = nextBlock.fetch_add(1)) < end) {
+                work(block);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+static void claimPath(TaskContext& context, size_t skier) {
+    auto [startRow, startCol] = context.task.points[skier];
+    if (!context.map.elevations.contains(startRow, startCol)) {
+        return;
+    }
+    int64_t cell = (int64_t)startRow * context.map.elevations.cols + startCol;
+    uint32_t point = 1;
+    while (context.sharedTails->claim(cell, (uint32_t)skier, point)) {
+        int64_t nextCell = context.memo.next(cell);
+        if (nextCell == cell) {
+            break;
+        }
+        cell = nextCell;
+        point++;
+    }
+}
+
+// Append a number to a buffer
+static void appendNumber(std::string& output, int64_t value) {
+    char digits[24];
+    auto [end, error] = std::to_chars(digits, digits + sizeof(digits), value);
+    output.append(digits, end);
+}
+
+static void batchBlock(TaskContext& context, size_t first, size_t end, int64_t* ends, int64_t* lengths) {
+    // Invalid start points are left out (and get no result)
+    std::vector<std::pair<int, int>> starts;
+    std::vector<size_t> skiers;
+    for (size_t i = first; i < end; i++) {
+        const auto& point = context.task.points[i];
+        if (context.map.elevations.contains(point.first, point.second)) {
+            starts.push_back(point);
+            skiers.push_back(i - first);
+        }
+    }
+    std::vector<int64_t> batchEnds(starts.size()), batchLengths(starts.size());
+    batchDescent(context.map.elevations, starts.data(), starts.size(), batchEnds.data(), batchLengths.data());
+    for (size_t k = 0; k < skiers.size(); k++) {
+        ends[skiers[k]] = batchEnds[k];
+        lengths[skiers[k]] = batchLengths[k];
+    }
+}
+
+static int64_t appendSkierResult(TaskContext& context, size_t skier, std::string& output, int64_t end, int64_t pathLength) {
+    if (context.binary) {
+        return appendSkierRecord(context, skier, output, end, pathLength);
+    }
+    const int cols = context.map.elevations.cols;
+    auto [startRow, startCol] = context.task.points[skier];
+    if (!context.map.elevations.contains(startRow, startCol)) {
+        output += "Start point at row=";
+        appendNumber(output, startRow + 1);
+        output += ", column=";
+        appendNumber(output, startCol + 1);
+        output += " is invalid.\n";
+        return 0;
+    }
+
+    // The end of the path and its length come from the batch, the index or
+    // the memo, so they are known before (and without) following the path
+    int64_t start = (int64_t)startRow * cols + startCol;
+    if (end < 0) {
+        context.memo.tail(start, end, pathLength);
+    }
+    appendNumber(output, startRow + 1);
+    output += ' ';
+    appendNumber(output, startCol + 1);
+    output += ' ';
+    appendNumber(output, end / cols + 1);
+    output += ' ';
+    appendNumber(output, end % cols + 1);
+    output += ' ';
+    appendNumber(output, pathLength);
+    output += '\n';
+    if (!context.task.traceMode) {
+        return pathLength;
+    }
+
+    // In the compact form, the path stops at the first point that is on the
+    // path of an earlier skier: "-> <skier> <point>" says that the rest of the
+    // path is the rest of that skier's path, from that point of it on
+    int64_t cell = start;
+    for (;;) {
+        if (context.sharedTails != nullptr) {
+            uint32_t owner, point;
+            context.sharedTails->owner(cell, owner, point);
+            if (owner != skier) {
+                output += "-> ";
+                appendNumber(output, (int64_t)owner + 1);
+                output += ' ';
+                appendNumber(output, point);
+                break;
+            }
+        }
+        appendNumber(output, cell / cols + 1);
+        output += ' ';
+        appendNumber(output, cell % cols + 1);
+        output += ' ';
+        int64_t nextCell = context.memo.next(cell);
+        if (nextCell == cell) {
+            break;
+        }
+        cell = nextCell;
+    }
+    output += '\n';
+    return pathLength;
+}
+
+static int64_t appendSkierRecord(TaskContext& context, size_t skier, std::string& output, int64_t end, int64_t pathLength) {
+    const int cols = context.map.elevations.cols;
+    auto [startRow, startCol] = context.task.points[skier];
+    BinarySkierRecord record = {startRow, startCol, startRow, startCol, 0};
+    const bool valid = context.map.elevations.contains(startRow, startCol);
+    int64_t start = (int64_t)startRow * cols + startCol;
+    if (valid) {
+        if (end < 0) {
+            context.memo.tail(start, end, pathLength);
+        }
+        record.endRow = (int32_t)(end / cols);
+        record.endCol = (int32_t)(end % cols);
+        record.length = (uint32_t)pathLength;
+    }
+    output.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    if (!valid || !context.task.traceMode) {
+        return valid ? pathLength : 0;
+    }
+
+    MovePacker moves(output);
+    for (int64_t cell = start, nextCell; (nextCell = context.memo.next(cell)) != cell; cell = nextCell) {
+        moves.add((int)(nextCell / cols - cell / cols), (int)(nextCell % cols - cell % cols));
+    }
+    moves.finish();
+    return pathLength;
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point begin) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// Append a string to a JSON document, quoted
+static void appendJsonString(std::string& output, const std::string& text) {
+    output += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            output += '\\';
+            output += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            output += escaped;
+        } else {
+            output += c;
+        }
+    }
+    output += '"';
+}
+
+static void printTaskStats(const std::string& mapName, const std::string& taskFilePath, const TaskStats& stats,
+                           StatsFormat format) {
+    const double averagePathLength = stats.skiers > 0 ? 1.0 + (double)stats.steps / stats.skiers : 0.0;
+    char numbers[512];
+    std::string line;
+    if (format == StatsFormat::JSON) {
+        line = "{\"map\":";
+        appendJsonString(line, mapName);
+        line += ",\"task\":";
+        appendJsonString(line, taskFilePath);
+        snprintf(numbers, sizeof(numbers),
+                 ",\"parse_ms\":%.3f,\"queue_ms\":%.3f,\"map_ms\":%.3f,\"index_ms\":%.3f,\"query_ms\":%.3f,\"output_ms\":%.3f,"
+                 "\"skiers\":%llu,\"steps\":%llu,\"avg_path_length\":%.2f,\"max_path_length\":%lld,"
+                 "\"bytes_written\":%llu,\"peak_rss_kb\":%ld,\"huge_pages_kb\":%ld}\n",
+                 stats.parseMs, stats.queueMs, stats.mapMs, stats.indexMs, stats.queryMs, stats.outputMs,
+                 (unsigned long long)stats.skiers, (unsigned long long)stats.steps, averagePathLength,
+                 (long long)stats.maxPathLength, (unsigned long long)stats.bytesWritten, stats.peakRssKb,
+                 stats.hugePagesKb);
+    } else {
+        line = "Stats for " + mapName + " (" + taskFilePath + "):";
+        snprintf(numbers, sizeof(numbers),
+                 " parse %.3f ms, queue %.3f ms, map %.3f ms, index %.3f ms, query %.3f ms, output %.3f ms;"
+                 " %llu skiers, %llu steps, path length %.2f avg, %lld max; %llu bytes written, peak RSS %ld KB, huge pages %ld KB\n",
+                 stats.parseMs, stats.queueMs, stats.mapMs, stats.indexMs, stats.queryMs, stats.outputMs,
+                 (unsigned long long)stats.skiers, (unsigned long long)stats.steps, averagePathLength,
+                 (long long)stats.maxPathLength, (unsigned long long)stats.bytesWritten, stats.peakRssKb,
+                 stats.hugePagesKb);
+    }
+    line += numbers;
+    // One write, so that the lines of concurrent skier dispatchers don't mix
+    std::vector<struct iovec> buffer = {{line.data(), line.size()}};
+    writeBuffers(STDERR_FILENO, buffer);
+}
+
+static bool placeOnHugePages(const ResidentMap& map) {
+    // A binary map is backed by its file, and paged in and out rather than kept resident
+    if (map.outOfCore) {
+        return true;
+    }
+    // The storage of the map and its index was allocated on huge pages already; this
+    // collapses what faulted in small, and places a shared map (not allocated here)
+    const ElevationMap& elevations = map.elevations;
+    bool placed;
+    if (!elevations.compactStorage.empty()) {
+        placed = useHugePages(elevations.compactStorage.data(), elevations.compactStorage.size() * sizeof(int16_t));
+    } else if (!elevations.storage.empty()) {
+        placed = useHugePages(elevations.storage.data(), elevations.storage.size() * sizeof(float));
+    } else {
+        placed = useHugePages(elevations.cells, (size_t)elevations.rows * elevations.cols * sizeof(float));
+    }
+    if (map.indexed) {
+        placed = useHugePages(map.index.direction.data(), map.index.direction.size()) && placed;
+        placed = useHugePages(map.index.basin.data(), map.index.basin.size() * sizeof(int32_t)) && placed;
+        placed = useHugePages(map.index.pathLength.data(), map.index.pathLength.size() * sizeof(int32_t)) && placed;
+    }
+    return placed;
+}
+
+static void show_error(const std::string& outputFilePath, const std::string& Output_String) {
+    std::ofstream outFile(outputFilePath);
+
+    // If you cant open output path exit
+    if (!outFile.is_open()) {
+        exit(11);
+    }
+
+    outFile << Output_String;
+}
@@ -0,0 +1,87 @@
+#ifndef SKIER_DISPATCHER_H
+#define SKIER_DISPATCHER_H
+
+#include <cstdint>
+#include <string>
+
+#include "elevationMap.h"
+#include "descentIndex.h"
+#include "descentField.h"
+#include "taskFile.h"
+
+// How a skier dispatcher reports the statistics of its tasks
+enum class StatsFormat {
+    NONE, // not measured
+    TEXT, // a line per task on the standard error
+    JSON  // a JSON object per task (one per line) on the standard error
+};
+
+// How a skier dispatcher loads and serves its map
+struct SkierDispatcherOptions {
+    bool sharedMaps = false;   // share the map with other processes through shared memory
+    bool useIndex = true;      // answer skiers from a descent index instead of searching the map
+    bool compactTrace = false; // TRACE paths refer to the paths of earlier skiers they join
+    bool binaryOutput = false; // write binary output files (.bout, see binaryOutput.h) instead of text
+    bool tiledMaps = false;    // store private maps in tiles (shared maps stay row-major)
+    bool fixedPoint = false;   // store private maps in 16-bit fixed point when they fit
+    StatsFormat stats = StatsFormat::NONE; // per-task timings and counters
+    bool hugePages = false;    // back the resident map and its index with transparent huge pages
+    bool numaInterleave = false; // interleave the resident map and its index over the NUMA nodes
+};
+
+// Where the time of a task went (in milliseconds) and what its skiers did.
+// Loading the map and building its index (or descent field) are done once per
+// skier dispatcher, and counted in the first task only.
+struct TaskStats {
+    double parseMs = 0.0;
+    double queueMs = 0.0;  // waiting for its turns, behind the other tasks of the map
+    double mapMs = 0.0;
+    double indexMs = 0.0;
+    double queryMs = 0.0;  // running the skiers (and formatting their output)
+    double outputMs = 0.0; // writing the output file
+    uint64_t skiers = 0;   // with a valid start point
+    uint64_t steps = 0;    // moves of all the skiers
+    int64_t maxPathLength = 0;
+    uint64_t bytesWritten = 0;
+    long peakRssKb = 0;    // of the skier dispatcher, so far
+    long hugePagesKb = 0;  // of the skier dispatcher backed by huge pages, now (-1 if unknown)
+};
+
+// A map and the indexes derived from it, as held by a skier dispatcher
+struct ResidentMap {
+    ElevationMap elevations;
+    DescentIndex index;
+    bool indexed = false;
+    DescentField field;     // binary maps only
+    bool outOfCore = false; // a binary map, mapped rather than read
+};
+
+// Memory a skier dispatcher holds for a rows x cols map
+size_t residentMapBytes(const std::string& mapFilePath, int rows, int cols, const SkierDispatcherOptions& options);
+
+// Entry point of a skier dispatcher process.
+// Loads the map once, then reads numbered task file paths (one per line) from commandFd
+// and runs each of them against the resident map, until commandFd is closed by
+// the general dispatcher. The skier tasks under way take turns, by priority.
+// Returns the exit code of the process.
+int runSkierDispatcher(const std::string& mapFilePath, const std::string& outputFolderPath, int commandFd,
+                       const SkierDispatcherOptions& options);
+
+// Change the elevations of a rectangle of a resident map, and bring its index
+// up to date. Returns false (and leaves the map as it is) if the patch does not
+// lie on the map, or the map is a binary map.
+bool applyPatch(ResidentMap& map, const MapPatch& patch);
+
+// Write the basin rasters of a resident map (see basinRaster.h). A map served
+// without a descent index gets one for the time of the export. Returns false
+// for a binary map (too large for rasters), or if a file could not be written.
+bool exportBasins(const ResidentMap& map, const std::string& outputPathPrefix, bool image);
+
+// Run the skiers of one task on a resident map and write the combined output file
+// (in start-point order, as the results come in). Fills in the query and output
+// parts of `stats`, if given (the skiers are only counted then).
+// Returns false if the output file could not be written.
+bool runTask(const ResidentMap& map, const Task& task, const std::string& outputFilePath,
+             const SkierDispatcherOptions& options, TaskStats* stats = nullptr);
+
+#endif // SKIER_DISPATCHER_H
@@ -0,0 +1,134 @@
+#include "taskFile.h"
+#include "elevationMap.h"
+
+#include <fstream>
+#include <sstream>
+
+// Removes the trailing spaces/carriage returns a task file may have been saved with
+static std::string trim(const std::string& line) {
+    size_t start = line.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = line.find_last_not_of(" \t\r\n");
+    return line.substr(start, end - start + 1);
+}
+
+// Parse the first non-blank line of a task file and, unless it is a
+// termination task, the map line after it
+static bool readTaskHeader(std::istream& inFile, Task& task) {
+    std::string line;
+    // Skip leading blank lines
+    do {
+        if (!std::getline(inFile, line)) {
+            return false;
+        }
+        line = trim(line);
+    } while (line.empty());
+
+    // Termination tasks: "END", "END ALL" or "END <map name>"
+    if (line == "END" || line.rfind("END ", 0) == 0) {
+        std::string target = trim(line.substr(3));
+        if (target.empty() || target == "ALL") {
+            task.kind = TaskKind::END_ALL;
+        } else {
+            task.kind = TaskKind::END_MAP;
+            task.mapFilePath = target;
+            task.mapName = extractMapName(target);
+        }
+        return true;
+    }
+
+    // First line: the trace mode (or PATCH, or BASINS)
+    task.kind = TaskKind::RUN_SKIERS;
+    if (line == "PATCH") {
+        task.kind = TaskKind::PATCH_MAP;
+    } else if (line == "BASINS" || line == "BASINS TGA") {
+        task.kind = TaskKind::EXPORT_BASINS;
+        task.basinImage = (line == "BASINS TGA");
+    } else if (line == "TRACE") {
+        task.traceMode = true;
+    } else if (line == "NO_TRACE" || line == "NOTRACE" || line == "NO TRACE") {
+        task.traceMode = false;
+    } else {
+        return false;
+    }
+
+    // Second line: the map. Older task files give the full command line
+    // ("./prog05v1 Data/smallMap_Vert.map"), so only the last word is kept.
+    if (!std::getline(inFile, line)) {
+        return false;
+    }
+    line = trim(line);
+    size_t lastSpace = line.find_last_of(" \t");
+    task.mapFilePath = (lastSpace == std::string::npos) ? line : line.substr(lastSpace + 1);
+    task.mapName = extractMapName(task.mapFilePath);
+    return true;
+}
+
+bool parseTaskHeader(const std::string& taskFilePath, Task& task) {
+    std::ifstream inFile(taskFilePath);
+    return inFile.is_open() && readTaskHeader(inFile, task);
+}
+
+// Read and parse a task file. Returns false if the file cannot be read or is malformed.
+bool parseTaskFile(const std::string& taskFilePath, Task& task) {
+    std::ifstream inFile(taskFilePath);
+    if (!inFile.is_open() || !readTaskHeader(inFile, task)) {
+        return false;
+    }
+
+    // Termination tasks are a single line, and basin rasters are for every
+    // cell: there is nothing more to read
+    if (task.kind == TaskKind::END_ALL || task.kind == TaskKind::END_MAP || task.kind == TaskKind::EXPORT_BASINS) {
+        return true;
+    }
+
+    std::string line;
+
+    // Patches: the (1-based) top left corner and the size of the rectangle,
+    // then its elevations, a row of the rectangle per line
+    if (task.kind == TaskKind::PATCH_MAP) {
+        MapPatch& patch = task.patch;
+        if (!std::getline(inFile, line) || !(std::istringstream(line) >> patch.row >> patch.col >> patch.rows >> patch.cols) ||
+            patch.rows <= 0 || patch.cols <= 0) {
+            return false;
+        }
+        patch.row--;
+        patch.col--;
+        patch.elevations.resize((size_t)patch.rows * patch.cols);
+        for (float& elevation : patch.elevations) {
+            if (!(inFile >> elevation)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Third line: optionally "PRIORITY <n>" (1 to MAX_TASK_PRIORITY), then the
+    // number of skiers, then one "row col" line per skier
+    if (!std::getline(inFile, line)) {
+        return false;
+    }
+    line = trim(line);
+    if (line.rfind("PRIORITY", 0) == 0) {
+        if (!(std::istringstream(line.substr(8)) >> task.priority) || task.priority < 1 ||
+            task.priority > MAX_TASK_PRIORITY || !std::getline(inFile, line)) {
+            return false;
+        }
+    }
+    int count = 0;
+    if (!(std::istringstream(line) >> count) || count < 0) {
+        return false;
+    }
+    task.points.clear();
+    task.points.reserve(count);
+    while ((int)task.points.size() < count && std::getline(inFile, line)) {
+        std::istringstream iss(line);
+        int row, col;
+        if (iss >> row >> col) {
+            task.points.push_back({row - 1, col - 1});
+        }
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef TASK_FILE_H
+#define TASK_FILE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// What a task file asks the dispatchers to do
+enum class TaskKind {
+    RUN_SKIERS,    // TRACE/NO_TRACE, map, [PRIORITY n,] count, start points
+    PATCH_MAP,     // PATCH, map, "row col rows cols", elevations: change part of a resident map
+    EXPORT_BASINS, // BASINS [TGA], map: write the basin rasters of a map (and their image)
+    END_MAP,       // END <map name>: terminate the skier dispatcher of one map
+    END_ALL        // END or END ALL: terminate everything
+};
+
+// New elevations for a rectangle of a map
+struct MapPatch {
+    int row = 0;  // 0-based top left corner
+    int col = 0;
+    int rows = 0; // size of the rectangle
+    int cols = 0;
+    std::vector<float> elevations; // row-major
+};
+
+// Highest priority a task file may ask for
+const int MAX_TASK_PRIORITY = 64;
+
+// Contents of a parsed task file
+struct Task {
+    TaskKind kind = TaskKind::RUN_SKIERS;
+    bool traceMode = false;
+    std::string mapFilePath; // path to the map (last word of the map line)
+    std::string mapName;     // map file name, used to find the skier dispatcher
+    std::vector<std::pair<int, int>> points; // 0-based start points
+    int priority = 1;                        // RUN_SKIERS only: share of the turns against other tasks of the map
+    MapPatch patch;                          // PATCH_MAP only
+    bool basinImage = false;                 // EXPORT_BASINS only: also write the TGA image
+};
+
+// Read and parse a task file. Returns false if the file cannot be read or is malformed.
+bool parseTaskFile(const std::string& taskFilePath, Task& task);
+
+// Read only the head of a task file: its kind (with the trace mode and the
+// basin image flag) and its map, but none of its start points or elevations.
+// Enough to route it to the skier dispatcher of its map, which parses the rest.
+// Returns false if the file cannot be read or its head is malformed.
+bool parseTaskHeader(const std::string& taskFilePath, Task& task);
+
+#endif // TASK_FILE_H
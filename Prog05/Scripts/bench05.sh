@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Check if the correct number of arguments are provided
+if [ "$#" -lt 1 ] || [ "$#" -gt 2 ]; then
+    echo "Usage: $0 <path to data folder> [scale]"
+    exit 1
+fi
+
+# Compile the benchmark against the Version 4 map code
+mkdir -p Compiled
+g++ Programs/Benchmark/layoutBenchmark.cpp Programs/Version4/elevationMap.cpp Programs/Version4/memoryPlacement.cpp Programs/Version4/descentIndex.cpp --std=c++20 -O2 -o Compiled/layout_benchmark || exit 1
+
+DATA_FOLDER="${1%/}"
+SCALE="${2:-1}"
+
+# Check if data folder exists
+if [ ! -d "$DATA_FOLDER" ]; then
+    echo "Data folder not found: $DATA_FOLDER"
+    exit 1
+fi
+
+# The three shapes of map, row-major against tiled
+Compiled/layout_benchmark -s "$SCALE" "$DATA_FOLDER"/hugeMap_Horiz.map "$DATA_FOLDER"/hugeMap_Vert.map "$DATA_FOLDER"/hugeMap_Sq.map
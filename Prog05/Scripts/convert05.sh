@@ -0,0 +1,13 @@
+#!/bin/bash
+
+# Check if the correct number of arguments are provided
+if [ "$#" -ne 2 ]; then
+    echo "Usage: $0 <path to text map> <path to binary map (.bmap)>"
+    exit 1
+fi
+
+# Compile the converter against the Version 4 map code
+mkdir -p Compiled
+g++ Programs/Tools/convertMap.cpp Programs/Version4/binaryMap.cpp Programs/Version4/elevationMap.cpp Programs/Version4/memoryPlacement.cpp --std=c++20 -O2 -o Compiled/convert_map || exit 1
+
+Compiled/convert_map "$1" "$2"
@@ -0,0 +1,13 @@
+#!/bin/bash
+
+# Check if the correct number of arguments are provided
+if [ "$#" -ne 2 ]; then
+    echo "Usage: $0 <path to binary output (.bout)> <path to text output>"
+    exit 1
+fi
+
+# Compile the decoder against the Version 4 output code
+mkdir -p Compiled
+g++ Programs/Tools/decodeOutput.cpp Programs/Version4/binaryOutput.cpp Programs/Version4/resultWriter.cpp --std=c++20 -O2 -o Compiled/decode_output || exit 1
+
+Compiled/decode_output "$1" "$2"
@@ -0,0 +1,13 @@
+#!/bin/bash
+
+# Check if the correct number of arguments are provided
+if [ "$#" -lt 3 ]; then
+    echo "Usage: $0 [-s <seed>] [-f <feature size>] [-p <plateau share>] [-q <step>] <size> <Sq|Horiz|Vert> <output map (.map or .bmap)>"
+    exit 1
+fi
+
+# Compile the generator against the Version 4 map code
+mkdir -p Compiled
+g++ Programs/Tools/generateTerrain.cpp Programs/Version4/binaryMap.cpp Programs/Version4/elevationMap.cpp Programs/Version4/memoryPlacement.cpp Programs/Version4/resultWriter.cpp --std=c++20 -O2 -pthread -o Compiled/generate_terrain || exit 1
+
+Compiled/generate_terrain "$@"
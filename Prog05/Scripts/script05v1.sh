@@ -14,7 +14,6 @@ chmod +x Compiled/*
 
 DATA_FOLDER=$1
 OUTPUT_FOLDER=$2
-TEMP_FOLDER="$OUTPUT_FOLDER/Temp"
 
 # Check if data folder exists
 if [ ! -d "$DATA_FOLDER" ]; then
@@ -29,43 +28,26 @@ else
     rm -rf "$OUTPUT_FOLDER"/*
 fi
 
-mkdir -p "$TEMP_FOLDER"
-
 # Process each task file in the data folder
 for task_file in "$DATA_FOLDER"/*.task; do
-    # Initialize variables
+    # Only the first two lines (mode and map) are read here: the skier count
+    # and the start points are streamed to the skier dispatcher as they are,
+    # so that large tasks don't have to fit in a command line.
     TRACE_FLAG=""
     MAP_FILE=""
-    SKIER_COUNT=0
-    SKIER_POINTS=()
-    
-    # Read the task file
-    while IFS= read -r line || [[ -n "$line" ]]; do
-        if [[ "$line" == "TRACE" ]]; then
-            TRACE_FLAG="-t"
-        elif [[ "$line" == "NO TRACE" ]]; then
-            TRACE_FLAG=""
-        elif [[ -z "$MAP_FILE" ]]; then
-            MAP_FILE="$line"
-        elif [[ "$SKIER_COUNT" -eq 0 ]]; then
-            SKIER_COUNT="$line"
-        else
-            SKIER_POINTS+=("$line")
-        fi
-    done < "$task_file"
-
-    # Construct the output file name
-    OUTPUT_FILE="$OUTPUT_FOLDER/"
-
-    # Construct the command to run the skier dispatcher
-    CMD="Compiled/prog05v3 $TRACE_FLAG $MAP_FILE"
-    for point in "${SKIER_POINTS[@]}"; do
-        CMD="$CMD $point"
-    done
-    CMD="$CMD $OUTPUT_FILE"
-
-    # Run the skier dispatcher command in the background
-    eval $CMD &
+    {
+        read -r MODE_LINE
+        read -r MAP_LINE
+    } < "$task_file"
+    if [[ "${MODE_LINE%$'\r'}" == "TRACE" ]]; then
+        TRACE_FLAG="-t"
+    fi
+    # Older task files give a whole command line: the map is its last word
+    MAP_LINE="${MAP_LINE%$'\r'}"
+    MAP_FILE="${MAP_LINE##* }"
+
+    # Run the skier dispatcher in the background
+    tail -n +3 "$task_file" | Compiled/prog05v3 $TRACE_FLAG -f - "$MAP_FILE" "$OUTPUT_FOLDER/" &
 done
 
 # Wait for all background processes to finish
@@ -32,41 +32,38 @@ mkdir -p "$TEMP_FOLDER"
 
 process_task_file() {
     TASK_FILE=$1
+    # Only the first two lines (mode and map) are read here: the skier count
+    # and the start points are streamed to the skier dispatcher as they are,
+    # so that large tasks don't have to fit in a command line.
     TRACE_FLAG=""
     MAP_FILE=""
-    SKIER_COUNT=0
-    SKIER_POINTS=()
-    
-    # Read the task file
-    while IFS= read -r line || [[ -n "$line" ]]; do
-        if [[ "$line" == "TRACE" ]]; then
-            TRACE_FLAG="-t"
-        elif [[ "$line" == "NO TRACE" ]]; then
-            TRACE_FLAG=""
-        elif [[ -z "$MAP_FILE" ]]; then
-            MAP_FILE="$line"
-        elif [[ "$SKIER_COUNT" -eq 0 ]]; then
-            SKIER_COUNT="$line"
-        else
-            SKIER_POINTS+=("$line")
-        fi
-    done < "$TASK_FILE"
-
-    # Construct the output file name
-    OUTPUT_FILE="$OUTPUT_FOLDER/"
+    {
+        read -r MODE_LINE
+        read -r MAP_LINE
+    } < "$TASK_FILE"
+    if [[ "${MODE_LINE%$'\r'}" == "TRACE" ]]; then
+        TRACE_FLAG="-t"
+    fi
+    # Older task files give a whole command line: the map is its last word
+    MAP_LINE="${MAP_LINE%$'\r'}"
+    MAP_FILE="${MAP_LINE##* }"
 
-    # Construct the command to run the skier dispatcher
-    CMD="Compiled/prog05v3 $TRACE_FLAG $MAP_FILE"
-    for point in "${SKIER_POINTS[@]}"; do
-        CMD="$CMD $point"
-    done
-    CMD="$CMD $OUTPUT_FILE"
+    # Run the skier dispatcher in the background
+    tail -n +3 "$TASK_FILE" | Compiled/prog05v3 $TRACE_FLAG -f - "$MAP_FILE" "$OUTPUT_FOLDER/" &
+}
 
-    # Run the skier dispatcher command in the background
-    eval $CMD &
+# Wait until a file is written to (or moved into) the watch folder. Without
+# inotifywait, or if a file came in while we were busy, the folder is checked
+# again after 5 seconds anyway.
+wait_for_files() {
+    if command -v inotifywait > /dev/null; then
+        inotifywait -qq -t 5 -e close_write -e moved_to "$WATCH_FOLDER"
+    else
+        sleep 5
+    fi
 }
 
-# Start the polling loop
+# Start the watch loop
 while true; do
     # Check for new .task files
     for FILE in "$WATCH_FOLDER"/*.task; do
@@ -89,6 +86,6 @@ while true; do
         fi
     done
 
-    # Sleep for a while before checking again
-    sleep 5
+    # Wait for the next files
+    wait_for_files
 done
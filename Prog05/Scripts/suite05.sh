@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Check if the correct number of arguments are provided
+if [ "$#" -lt 2 ]; then
+    echo "Usage: $0 <path to data folder> <path to CSV file> [size of generated map]..."
+    exit 1
+fi
+
+# Compile the Version 3 dispatcher, the terrain generator and the suite (against the Version 4 code, without its main)
+mkdir -p Compiled
+g++ Programs/Version3/prog05v3.cpp --std=c++20 -O2 -o Compiled/prog05v3 || exit 1
+g++ Programs/Tools/generateTerrain.cpp Programs/Version4/binaryMap.cpp Programs/Version4/elevationMap.cpp Programs/Version4/memoryPlacement.cpp Programs/Version4/resultWriter.cpp --std=c++20 -O2 -pthread -o Compiled/generate_terrain || exit 1
+V4_SOURCES=$(ls Programs/Version4/*.cpp | grep -v prog05v4.cpp)
+g++ Programs/Benchmark/suiteBenchmark.cpp $V4_SOURCES --std=c++20 -O2 -pthread -lrt -o Compiled/suite_benchmark || exit 1
+
+DATA_FOLDER="${1%/}"
+CSV_FILE="$2"
+shift 2
+
+# Check if data folder exists
+if [ ! -d "$DATA_FOLDER" ]; then
+    echo "Data folder not found: $DATA_FOLDER"
+    exit 1
+fi
+
+# Scratch folder for the generated maps and the task outputs
+SCRATCH_FOLDER=$(mktemp -d "${TMPDIR:-/tmp}/suite05.XXXXXX")
+trap 'rm -rf "$SCRATCH_FOLDER"' EXIT
+
+# The maps of the data folder, then a square map of each size asked for
+MAPS=("$DATA_FOLDER"/*.map)
+for size in "$@"; do
+    Compiled/generate_terrain "$size" Sq "$SCRATCH_FOLDER/generated_$size.map" || exit 1
+    MAPS+=("$SCRATCH_FOLDER/generated_$size.map")
+done
+
+Compiled/suite_benchmark -v3 Compiled/prog05v3 -o "$SCRATCH_FOLDER" "${MAPS[@]}" > "$CSV_FILE"
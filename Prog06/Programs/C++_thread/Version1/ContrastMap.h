@@ -0,0 +1,40 @@
+#ifndef CONTRAST_MAP_H
+#define CONTRAST_MAP_H
+
+#include "RasterImage.h"
+
+/**
+ * @brief Computes rows of the contrast map of a gray plane.
+ *
+ * The contrast of a pixel is the range (max - min) of the gray values in the
+ * windowSize x windowSize window centered on it, clipped at the image borders.
+ * The max and the min are computed with a separable van Herk/Gil-Werman sliding
+ * filter (a pass over the rows, then one over the columns), so their cost per pixel
+ * does not depend on the window size.
+ *
+ * Only rows [firstRow, endRow) of the map are written, so threads can compute
+ * disjoint bands of the same map.
+ *
+ * @param grayPlane The gray plane (GRAY_RASTER).
+ * @param windowSize Side of the window (odd).
+ * @param contrastMap The contrast map (GRAY_RASTER, the size of the gray plane).
+ * @param firstRow First row to compute.
+ * @param endRow Row after the last row to compute.
+ */
+void computeContrastMap(const RasterImage* grayPlane, int windowSize, RasterImage* contrastMap,
+                        unsigned int firstRow, unsigned int endRow);
+
+/**
+ * @brief Contrast of a pixel, read off a contrast map.
+ *
+ * @param contrastMap The contrast map.
+ * @param row The row of the pixel.
+ * @param col The column of the pixel.
+ * @return The contrast value.
+ */
+inline int contrastAt(const RasterImage* contrastMap, unsigned int row, unsigned int col)
+{
+    return static_cast<const unsigned char*>(contrastMap->raster)[row * contrastMap->width + col];
+}
+
+#endif // CONTRAST_MAP_H
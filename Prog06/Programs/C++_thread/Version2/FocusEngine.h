@@ -0,0 +1,191 @@
+#ifndef FOCUS_ENGINE_H
+#define FOCUS_ENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "RasterImage.h"
+
+/**
+ * @brief A tile of the output image: a band of full rows.
+ */
+struct FocusTile {
+    unsigned int index;
+    unsigned int firstRow;
+    unsigned int endRow;
+};
+
+/**
+ * @brief A blending window, centered on a pixel, with the input image that has the most contrast there.
+ */
+struct FocusWindow {
+    unsigned int centerRow;
+    unsigned int centerCol;
+    unsigned int bestImage;
+};
+
+/**
+ * @brief Hands out the tiles of an image to workers, each tile exactly once.
+ *
+ * Every worker starts with a contiguous range of tiles and takes them from the front.
+ * A worker whose range is empty steals the back half of the largest range left.
+ * A range is a single atomic word (front and back), so taking and stealing are
+ * both one compare-and-swap, and no lock is needed.
+ */
+class TileQueue {
+public:
+    TileQueue(unsigned int numTiles, unsigned int numWorkers);
+
+    /**
+     * @brief Gets the next tile for a worker.
+     *
+     * @param worker The worker (0 to numWorkers - 1).
+     * @param tile Set to the tile number.
+     * @return false once every tile has been handed out.
+     */
+    bool next(unsigned int worker, unsigned int& tile);
+
+private:
+    struct alignas(64) Range {
+        std::atomic<uint64_t> bounds; // front in the low 32 bits, back (excluded) in the high 32 bits
+    };
+    unsigned int numWorkers;
+    std::unique_ptr<Range[]> ranges;
+};
+
+/**
+ * @brief Splits the focusing of an image stack into tiles, and computes what goes in each one.
+ *
+ * The contrast maps are filled a tile at a time, as the tiles are focused, so that
+ * a tile only waits on its own rows. The best image of a pixel (or a window) is the
+ * first one, in stack order, with the most contrast there, so a run always produces
+ * the same output, whichever worker focuses which tile.
+ */
+class FocusEngine {
+public:
+    /**
+     * @param grayPlanes The gray planes of the input images.
+     * @param contrastMaps The contrast maps of the input images (allocated, filled by measureContrast).
+     * @param contrastWindowSize Side of the window the contrast is measured over.
+     * @param numWorkers Number of workers that will ask for tiles.
+     */
+    FocusEngine(const std::vector<RasterImage*>& grayPlanes, const std::vector<RasterImage*>& contrastMaps,
+                int contrastWindowSize, unsigned int numWorkers);
+
+    unsigned int imageWidth() const { return width; }
+    unsigned int imageHeight() const { return height; }
+    unsigned int numTiles() const { return tileCount; }
+
+    /**
+     * @brief The rows of a tile.
+     *
+     * @param index The tile number (0 to numTiles() - 1).
+     */
+    FocusTile tile(unsigned int index) const;
+
+    /**
+     * @brief Gets the next tile to focus for a worker.
+     *
+     * @return false once every tile has been handed out.
+     */
+    bool nextTile(unsigned int worker, FocusTile& tile);
+
+    /**
+     * @brief Fills the rows of a tile in every contrast map.
+     */
+    void measureContrast(const FocusTile& tile);
+
+    /**
+     * @brief Finds the best image of every pixel of a tile (after measureContrast).
+     *
+     * @param tile The tile.
+     * @param bestImages Set to the index of the best image of each pixel, row by row
+     *                   (so at most 256 images).
+     */
+    void selectPixels(const FocusTile& tile, std::vector<unsigned char>& bestImages) const;
+
+    /**
+     * @brief Finds the best image of every blending window centered in a tile (after measureContrast).
+     *
+     * The windows are centered on a grid with a step of windowSize / 2 + 1 pixels, so that
+     * together they cover the whole image, and neighboring windows overlap.
+     *
+     * @param tile The tile.
+     * @param windowSize Side of the blending windows.
+     * @param windows Set to the windows centered in the tile.
+     */
+    void selectWindows(const FocusTile& tile, int windowSize, std::vector<FocusWindow>& windows) const;
+
+private:
+    const std::vector<RasterImage*>& grayPlanes;
+    const std::vector<RasterImage*>& contrastMaps;
+    int contrastWindowSize;
+    unsigned int width;
+    unsigned int height;
+    unsigned int tileRows;
+    unsigned int tileCount;
+    TileQueue queue;
+};
+
+/**
+ * @brief Blends overlapping windows into the output image, without locks.
+ *
+ * The windows centered in a tile are summed into a buffer of that tile only (its rows,
+ * and the rows its windows spill into), which only the worker focusing the tile writes.
+ * Once every tile has been added, each output pixel is the average of the windows that
+ * cover it, summed over the buffers of its tile and of the tiles next to it, so the result
+ * does not depend on which worker added which tile, or in what order.
+ */
+class WindowBlender {
+public:
+    /**
+     * @param engine The focus engine that hands out the tiles.
+     * @param windowSize Side of the blending windows.
+     */
+    WindowBlender(const FocusEngine& engine, int windowSize);
+
+    /**
+     * @brief Adds a window centered in a tile to the buffer of the tile.
+     *
+     * @param tile The tile.
+     * @param window The window.
+     * @param image The best image of the window.
+     */
+    void add(const FocusTile& tile, const FocusWindow& window, const RasterImage* image);
+
+    /**
+     * @brief Records that every window of a tile has been added.
+     */
+    void tileDone();
+
+    /**
+     * @brief Waits until every tile has been added (tileDone), or keepGoing is cleared.
+     *
+     * @return true if every tile has been added.
+     */
+    bool waitForAllTiles(const std::atomic<bool>& keepGoing) const;
+
+    /**
+     * @brief Writes the blended pixels of a tile to the output image (after waitForAllTiles).
+     *
+     * @param tile The tile.
+     * @param output The output image.
+     */
+    void compose(const FocusTile& tile, RasterImage* output) const;
+
+private:
+    struct TileSums {
+        unsigned int firstRow;        // first row reached by the windows of the tile
+        unsigned int endRow;          // row after the last one
+        std::vector<uint32_t> sums;   // red, green and blue, per pixel
+        std::vector<uint16_t> counts; // windows per pixel
+    };
+    unsigned int width;
+    int windowSize;
+    std::vector<TileSums> tileSums;
+    std::atomic<unsigned int> numTilesDone;
+};
+
+#endif // FOCUS_ENGINE_H
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "ContrastMap.h"
+
+namespace {
+
+/**
+ * @brief The max of gray values, with its identity (the padding past the borders).
+ */
+struct Max {
+    static constexpr unsigned char identity = 0;
+    unsigned char operator()(unsigned char a, unsigned char b) const { return a > b ? a : b; }
+};
+
+/**
+ * @brief The min of gray values, with its identity (the padding past the borders).
+ */
+struct Min {
+    static constexpr unsigned char identity = 255;
+    unsigned char operator()(unsigned char a, unsigned char b) const { return a < b ? a : b; }
+};
+
+/**
+ * @brief Sliding extremum along a row: out[x] is the extremum of in[x - radius .. x + radius].
+ *
+ * The padded row is cut into blocks of one window. For each value, forward holds the
+ * extremum from the start of its block, backward the extremum to the end of its block;
+ * a window spans the end of one block and the start of the next, so it takes one of each.
+ */
+template <typename Extremum>
+void slideRow(const unsigned char* in, unsigned char* out, int width, int radius, std::vector<unsigned char>& padded,
+              std::vector<unsigned char>& forward, std::vector<unsigned char>& backward)
+{
+    Extremum extremum;
+    const int window = 2 * radius + 1;
+    const int length = width + 2 * radius;
+
+    std::fill(padded.begin(), padded.begin() + radius, Extremum::identity);
+    memcpy(padded.data() + radius, in, width);
+    std::fill(padded.begin() + radius + width, padded.begin() + length, Extremum::identity);
+
+    for (int i = 0; i < length; i++) {
+        forward[i] = i % window == 0 ? padded[i] : extremum(forward[i - 1], padded[i]);
+    }
+    for (int i = length - 1; i >= 0; i--) {
+        backward[i] = (i == length - 1 || (i + 1) % window == 0) ? padded[i] : extremum(backward[i + 1], padded[i]);
+    }
+    for (int x = 0; x < width; x++) {
+        out[x] = extremum(backward[x], forward[x + 2 * radius]);
+    }
+}
+
+/**
+ * @brief Sliding extremum down the columns, for rows [firstRow, endRow).
+ *
+ * The same blocks as slideRow, with whole rows as values, so that every inner loop
+ * runs along a row.
+ *
+ * @param in Rows [inFirst, inEnd) of the input, where inFirst = max(0, firstRow - radius)
+ *           and inEnd = min(height, endRow + radius).
+ * @param out Rows [firstRow, endRow) of the output.
+ */
+template <typename Extremum>
+void slideColumns(const unsigned char* in, unsigned char* out, int width, int height, int radius, int firstRow, int endRow,
+                  std::vector<unsigned char>& forward, std::vector<unsigned char>& backward)
+{
+    Extremum extremum;
+    const int window = 2 * radius + 1;
+    const int length = endRow - firstRow + 2 * radius;
+    const int inFirst = std::max(0, firstRow - radius);
+    const int inEnd = std::min(height, endRow + radius);
+    const std::vector<unsigned char> padding(width, Extremum::identity);
+
+    // Row i of the padded band is row firstRow - radius + i of the input
+    auto paddedRow = [&](int i) {
+        int row = firstRow - radius + i;
+        return (row >= inFirst && row < inEnd) ? in + static_cast<size_t>(row - inFirst) * width : padding.data();
+    };
+
+    for (int i = 0; i < length; i++) {
+        const unsigned char* value = paddedRow(i);
+        unsigned char* f = forward.data() + static_cast<size_t>(i) * width;
+        if (i % window == 0) {
+            memcpy(f, value, width);
+        } else {
+            const unsigned char* previous = f - width;
+            for (int x = 0; x < width; x++) {
+                f[x] = extremum(previous[x], value[x]);
+            }
+        }
+    }
+    for (int i = length - 1; i >= 0; i--) {
+        const unsigned char* value = paddedRow(i);
+        unsigned char* b = backward.data() + static_cast<size_t>(i) * width;
+        if (i == length - 1 || (i + 1) % window == 0) {
+            memcpy(b, value, width);
+        } else {
+            const unsigned char* next = b + width;
+            for (int x = 0; x < width; x++) {
+                b[x] = extremum(next[x], value[x]);
+            }
+        }
+    }
+    for (int row = firstRow; row < endRow; row++) {
+        const unsigned char* b = backward.data() + static_cast<size_t>(row - firstRow) * width;
+        const unsigned char* f = forward.data() + static_cast<size_t>(row - firstRow + 2 * radius) * width;
+        unsigned char* o = out + static_cast<size_t>(row - firstRow) * width;
+        for (int x = 0; x < width; x++) {
+            o[x] = extremum(b[x], f[x]);
+        }
+    }
+}
+
+} // namespace
+
+void computeContrastMap(const RasterImage* grayPlane, int windowSize, RasterImage* contrastMap,
+                        unsigned int firstRow, unsigned int endRow)
+{
+    const int width = grayPlane->width;
+    const int height = grayPlane->height;
+    const int radius = windowSize / 2;
+    const int first = firstRow;
+    const int end = std::min(static_cast<int>(endRow), height);
+    if (first >= end) {
+        return;
+    }
+
+    // Rows pass, over every row that a window of the band reaches
+    const int inFirst = std::max(0, first - radius);
+    const int inEnd = std::min(height, end + radius);
+    const size_t inSize = static_cast<size_t>(inEnd - inFirst) * width;
+    std::vector<unsigned char> rowMax(inSize), rowMin(inSize);
+    std::vector<unsigned char> padded(width + 2 * radius), forward(width + 2 * radius), backward(width + 2 * radius);
+    const unsigned char* gray = static_cast<const unsigned char*>(grayPlane->raster);
+    for (int row = inFirst; row < inEnd; row++) {
+        const unsigned char* in = gray + static_cast<size_t>(row) * width;
+        const size_t offset = static_cast<size_t>(row - inFirst) * width;
+        slideRow<Max>(in, rowMax.data() + offset, width, radius, padded, forward, backward);
+        slideRow<Min>(in, rowMin.data() + offset, width, radius, padded, forward, backward);
+    }
+
+    // Columns pass, then the range
+    const size_t bandSize = static_cast<size_t>(end - first) * width;
+    std::vector<unsigned char> windowMax(bandSize), windowMin(bandSize);
+    forward.resize(static_cast<size_t>(end - first + 2 * radius) * width);
+    backward.resize(forward.size());
+    slideColumns<Max>(rowMax.data(), windowMax.data(), width, height, radius, first, end, forward, backward);
+    slideColumns<Min>(rowMin.data(), windowMin.data(), width, height, radius, first, end, forward, backward);
+
+    unsigned char* contrast = static_cast<unsigned char*>(contrastMap->raster) + static_cast<size_t>(first) * width;
+    for (size_t k = 0; k < bandSize; k++) {
+        contrast[k] = windowMax[k] - windowMin[k];
+    }
+}
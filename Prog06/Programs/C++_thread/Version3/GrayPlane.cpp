@@ -0,0 +1,69 @@
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "GrayPlane.h"
+
+/**
+ * @brief Fixed-point weights (out of 256) of the red, green and blue channels.
+ */
+const unsigned int RED_WEIGHT = 54;
+const unsigned int GREEN_WEIGHT = 184;
+const unsigned int BLUE_WEIGHT = 18;
+
+/**
+ * @brief Converts a run of RGBA pixels to gray.
+ *
+ * @param rgba The RGBA pixels.
+ * @param gray The gray values (one byte per pixel).
+ * @param numPixels Number of pixels to convert.
+ */
+static void convertRGBAToGray(const unsigned char* rgba, unsigned char* gray, size_t numPixels)
+{
+    size_t pixel = 0;
+
+#if defined(__SSE2__)
+    // As 16-bit lanes, a pixel is (R | G << 8), (B | A << 8): the low bytes give R and B,
+    // the high bytes G and A, and one multiply-add per pair gives a weighted pixel.
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i redBlueWeights = _mm_set1_epi32((BLUE_WEIGHT << 16) | RED_WEIGHT);
+    const __m128i greenWeights = _mm_set1_epi32(GREEN_WEIGHT);
+    const __m128i rounding = _mm_set1_epi32(128);
+    for (; pixel + 16 <= numPixels; pixel += 16) {
+        __m128i sums[4];
+        for (int k = 0; k < 4; k++) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + (pixel + 4 * k) * 4));
+            __m128i redBlue = _mm_and_si128(pixels, lowBytes);
+            __m128i greenAlpha = _mm_srli_epi16(pixels, 8);
+            __m128i sum = _mm_add_epi32(_mm_madd_epi16(redBlue, redBlueWeights),
+                                        _mm_madd_epi16(greenAlpha, greenWeights));
+            sums[k] = _mm_srli_epi32(_mm_add_epi32(sum, rounding), 8);
+        }
+        // Every sum fits in a byte, so packing never saturates
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]), _mm_packs_epi32(sums[2], sums[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + pixel), packed);
+    }
+#endif
+
+    for (; pixel < numPixels; pixel++) {
+        const unsigned char* p = rgba + pixel * 4;
+        gray[pixel] = static_cast<unsigned char>((RED_WEIGHT * p[0] + GREEN_WEIGHT * p[1] + BLUE_WEIGHT * p[2] + 128) >> 8);
+    }
+}
+
+RasterImage* convertToGrayPlane(const RasterImage* image)
+{
+    RasterImage* plane = new RasterImage(image->width, image->height, GRAY_RASTER);
+    const size_t numPixels = static_cast<size_t>(image->width) * image->height;
+    unsigned char* gray = static_cast<unsigned char*>(plane->raster);
+
+    if (image->type == RGBA32_RASTER) {
+        convertRGBAToGray(static_cast<const unsigned char*>(image->raster), gray, numPixels);
+    }
+    else if (image->type == GRAY_RASTER) {
+        memcpy(gray, image->raster, numPixels);
+    }
+    return plane;
+}
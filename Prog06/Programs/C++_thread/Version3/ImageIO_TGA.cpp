@@ -17,11 +17,19 @@
 
 #include <cstdlib>        
 #include <cstdio>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#endif
 
 #include "ImageIO_TGA.h"
 
 void swapRGB_(unsigned char* theData, unsigned int height, unsigned int width);
-void swapRGBA_(unsigned char* theData, unsigned int height, unsigned int width);
+void expandBGRToRGBA_(const unsigned char* bgr, unsigned char* rgba, unsigned int numPixels);
+#if defined(__x86_64__) || defined(__i386__)
+unsigned int expandBGRToRGBA_SSSE3_(const unsigned char* bgr, unsigned char* rgba, unsigned int numPixels);
+#endif
 
 
 //----------------------------------------------------------------------
@@ -40,14 +48,58 @@ void swapRGB_(unsigned char* theData, unsigned int height, unsigned int width)
 	}
 }
 
-void swapRGBA_(unsigned char* theData, unsigned int height, unsigned int width)
+#if defined(__x86_64__) || defined(__i386__)
+//----------------------------------------------------------------------
+//	SSSE3 part of expandBGRToRGBA_: shuffles 16 pixels (48 bytes in,
+//	64 out) at a time, and returns the number of pixels expanded.
+//	Compiled for SSSE3 whatever the build flags, and only called on
+//	processors that have it.
+//----------------------------------------------------------------------
+__attribute__((target("ssse3")))
+unsigned int expandBGRToRGBA_SSSE3_(const unsigned char* bgr, unsigned char* rgba, unsigned int numPixels)
 {
-    unsigned int numBytes = height*width;
-    
-    for(unsigned int k=0; k<numBytes; k++){
-        unsigned char temp = theData[k*4+2];
-        theData[k*4+2] = theData[k*4];
-        theData[k*4] = temp;
+    unsigned int k = 0;
+
+    //	Four BGR pixels (the low 12 bytes of a register) to four RGBA pixels
+    const __m128i toRGBA = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+    for (; k + 16 <= numPixels; k += 16)
+    {
+        const unsigned char* in = bgr + k*3;
+        __m128i a = _mm_loadu_si128((const __m128i*) in);
+        __m128i b = _mm_loadu_si128((const __m128i*) (in + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*) (in + 32));
+        __m128i* out = (__m128i*) (rgba + k*4);
+        _mm_storeu_si128(out, _mm_shuffle_epi8(a, toRGBA));
+        _mm_storeu_si128(out + 1, _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), toRGBA));
+        _mm_storeu_si128(out + 2, _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), toRGBA));
+        _mm_storeu_si128(out + 3, _mm_shuffle_epi8(_mm_srli_si128(c, 4), toRGBA));
+    }
+    return k;
+}
+#endif
+
+//----------------------------------------------------------------------
+//	Expands a run of BGR pixels (as stored in a TGA file) to RGBA in one
+//	pass, with the alpha channel set to 0.
+//	On processors with SSSE3, 16 pixels are shuffled at a time.
+//----------------------------------------------------------------------
+void expandBGRToRGBA_(const unsigned char* bgr, unsigned char* rgba, unsigned int numPixels)
+{
+    unsigned int k = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        k = expandBGRToRGBA_SSSE3_(bgr, rgba, numPixels);
+    }
+#endif
+
+    for (; k < numPixels; k++)
+    {
+        rgba[k*4] = bgr[k*3+2];
+        rgba[k*4+1] = bgr[k*3+1];
+        rgba[k*4+2] = bgr[k*3];
+        rgba[k*4+3] = 0;
     }
 }
 
@@ -120,36 +172,28 @@ RasterImage* readTGA(const char* filePath)
 	//if (image.type == kTGA_COLOR) *****************************
 	if(image->type == RGBA32_RASTER)
 	{
+		//	The whole pixel block in one read
+		std::vector<unsigned char> bgr((size_t) numBytes*3);
+		if (fread(bgr.data(), 3*sizeof(char), numBytes, tga_in) != numBytes)
+		{
+			printf("Image file %s is truncated\n", filePath);
+			fclose(tga_in);
+			exit(13);
+		}
+
+        //  tga files store color information in the order B-G-R
+        //  we need to swap the Red and Blue components, and add the alpha channel
 		//	First check if the image is mirrored vertically (a bit setting in the header)
 		if(head[17]&0x20)
 		{
-			unsigned char* ptr = data + numBytes*4 - image->bytesPerRow;
 			for(unsigned int i = 0; i < image->height; i++)
 			{
-                for (unsigned int j=0; j<image->width; j++)
-                {
-                    fread(ptr, 3*sizeof(char), 1, tga_in);
-					ptr -= 4;
-                }
+				expandBGRToRGBA_(bgr.data() + (size_t) i*image->width*3,
+								 data + (size_t) (image->height-1-i)*image->bytesPerRow, image->width);
 			}
 		}
 		else
-        {
-            unsigned char* dest = data;
-            for (unsigned int i=0; i<image->height; i++)
-            {
-                for (unsigned int j=0; j<image->width; j++)
-                {
-                    fread(dest, 3*sizeof(char), 1, tga_in);
-                    dest+=4;
-                }
-            }
-			
-        }
-        
-        //  tga files store color information in the order B-G-R
-        //  we need to swap the Red and Blue components
-    	swapRGBA_(data, image->height, image->width);
+			expandBGRToRGBA_(bgr.data(), data, numBytes);
 	}
 
 	//	Case of a gray-level image
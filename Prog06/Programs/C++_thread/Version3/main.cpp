@@ -4,7 +4,9 @@
  * 
  * This file contains the main functionality for Nicholas Faciano's assignment,
  * which involves processing multiple images to produce a single focused image using multithreading.
- * Version 3 of the assignment focuses on using multiple locks for synchronization.
+ * Version 3 runs the same pipeline as Version 2, with no locks: the threads take tiles of the
+ * output image from a work-stealing queue, blend their windows into a buffer per tile, and each
+ * writes the tiles it focused to the output image once every tile is blended.
  *
  * @author Nicholas Faciano
  * @date 12/2/2023
@@ -17,12 +19,15 @@
 #include <cstring>
 #include <cstdio>
 #include <cstdlib>
-#include <mutex>
 #include <time.h>
 #include <atomic>
-#include <set>
+#include <chrono>
+#include <algorithm>
 #include "gl_frontEnd.h"
 #include "ImageIO_TGA.h"
+#include "GrayPlane.h"
+#include "ContrastMap.h"
+#include "FocusEngine.h"
 
 using namespace std;
 
@@ -64,15 +69,47 @@ RasterImage* imageOut;
  */
 std::vector<RasterImage*> images;
 
+/**
+ * @brief Gray planes of the input images (in the same order), converted once when the images are loaded.
+ */
+std::vector<RasterImage*> grayPlanes;
+
+/**
+ * @brief Contrast maps of the input images (in the same order).
+ */
+std::vector<RasterImage*> contrastMaps;
+
+/**
+ * @brief Side of the window over which the contrast of a pixel is measured (--window, odd).
+ */
+int contrastWindowSize = 5;
+
+/**
+ * @brief Side of the windows blended into the output image.
+ */
+const int BLEND_WINDOW_SIZE = 11;
+
+/**
+ * @brief Hands out the tiles of the output image to the focusing threads.
+ */
+FocusEngine* focusEngine;
+
+/**
+ * @brief Blends the windows of the focusing threads into the output image, a buffer per tile.
+ */
+WindowBlender* windowBlender;
+
 /**
  * @brief Threads used for processing the image stack.
  */
 std::vector<std::thread> threads;
 
+
 /**
- * @brief Mutex for synchronizing access to the output image.
+ * @brief True when running without the GUI (--headless): once the threads have focused
+ * every tile, the output image is saved and the program exits.
  */
-std::mutex imageMutex;
+bool headless = false;
 
 /**
  * @brief Random device for generating random numbers.
@@ -104,16 +141,6 @@ uniform_int_distribution<unsigned int> colDist;
  */
 string outputPath;
 
-/**
- * @brief Number of rows in the grid for locking regions of the image.
- */
-const int GRID_ROWS = 4; // For example, if you want 16 locks, you could create a 4x4 grid
-
-/**
- * @brief Number of columns in the grid for locking regions of the image.
- */
-const int GRID_COLS = 4;
-
 /**
  * @brief Maximum number of messages that can be displayed in the application's interface.
  */
@@ -124,11 +151,6 @@ const int MAX_NUM_MESSAGES = 8;
  */
 const int MAX_LENGTH_MESSAGE = 32;
 
-/**
- * @brief Array of mutexes for the grid, used for region-based locking in image processing.
- */
-std::mutex gridMutexes[GRID_ROWS][GRID_COLS];
-
 
 
 /**
@@ -221,8 +243,10 @@ void cleanupAndQuit(void) {
     continue_going = false;
 
     // Join threads
-    for (int i = 0; i < numThreads; ++i) {
-        pthread_join(threads[i], NULL); // Using pthread_join to wait for thread completion
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
     }
 
     // Clean up images
@@ -232,15 +256,68 @@ void cleanupAndQuit(void) {
     }
     images.clear();
 
-   for (int i = 0; i < numThreads; ++i) {
-        pthread_join(threads[i], NULL); // Using pthread_join
+    for (auto plane : grayPlanes) {
+        delete plane;
     }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
 
-    // No need to delete the threads vector
+    // Exit the program
+    exit(0);
+}
 
-    pthread_mutex_destroy(&imageMutex);
+/**
+ * @brief Waits for the focusing threads, then saves the output image, reports the
+ * timings and exits (headless mode).
+ *
+ * @param loadStart Time at which the input images started loading.
+ * @param focusStart Time at which the focusing threads were started.
+ */
+void finishHeadless(std::chrono::steady_clock::time_point loadStart, std::chrono::steady_clock::time_point focusStart)
+{
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    auto focusEnd = std::chrono::steady_clock::now();
+
+    writeTGA(outputPath.c_str(), imageOut);
+    auto saveEnd = std::chrono::steady_clock::now();
+
+    auto milliseconds = [](auto begin, auto end) {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    };
+    printf("Focused %zu images of %ux%u with %zu threads\n", images.size(), imageOut->width, imageOut->height,
+           threads.size());
+    printf("Load: %.3f ms, focus: %.3f ms, save: %.3f ms\n", milliseconds(loadStart, focusStart),
+           milliseconds(focusStart, focusEnd), milliseconds(focusEnd, saveEnd));
+
+    for (int k = 0; k < MAX_NUM_MESSAGES; k++) {
+        free(message[k]);
+    }
+    free(message);
+    for (auto& img : images) {
+        delete img;
+    }
+    images.clear();
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
+    delete imageOut;
 
-    // Exit the program
     exit(0);
 }
 
@@ -281,155 +358,39 @@ void handleKeyboardEvent(unsigned char c, int x, int y)
 
 
 /**
- * @brief Converts a pixel to grayscale.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the pixel.
- * @param col The column of the pixel.
- * @return The grayscale value of the pixel.
- */
-double convertToGrayscale(RasterImage* image, int row, int col) {
-    if (image->type == RGBA32_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col) * 4;
-        // Using a weighted average for human perception: 0.21 R + 0.72 G + 0.07 B
-        return 0.21 * pixel[0] + 0.72 * pixel[1] + 0.07 * pixel[2];
-    }
-    else if (image->type == GRAY_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col);
-        return *pixel;
-    }
-    return 0;
-}
-
-/**
- * @brief Calculates the contrast of a window around a pixel.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the central pixel of the window.
- * @param col The column of the central pixel of the window.
- * @return The contrast value.
- */
-double calculateWindowContrast(RasterImage* image, int row, int col, int windowSize){
-    double minGray = 255.0, maxGray = 0.0;
-
-    for (int i = -2; i <= 2; i++) {
-        for (int j = -2; j <= 2; j++) {
-            int neighborRow = row + i;
-            int neighborCol = col + j;
-            if (neighborRow >= 0 && neighborRow < image->height && neighborCol >= 0 && neighborCol < image->width) {
-                double gray = convertToGrayscale(image, neighborRow, neighborCol);
-                minGray = std::min(minGray, gray);
-                maxGray = std::max(maxGray, gray);
-            }
-        }
-    }
-
-    return maxGray - minGray; // Contrast is the range of grayscale values
-}
-
-/**
-/**
- * @brief Copies a pixel from one image to another.
- * 
- * @param srcImage Source image.
- * @param dstImage Destination image.
- * @param row Row of the pixel to copy.
- * @param col Column of the pixel to copy.
- */
-
-void copyPixel(RasterImage* srcImage, RasterImage* dstImage, int row, int col) {
-    unsigned char* srcPixel = static_cast<unsigned char*>(srcImage->raster) + (row * srcImage->width + col) * 4;
-    unsigned char* dstPixel = static_cast<unsigned char*>(dstImage->raster) + (row * dstImage->width + col) * 4;
-
-    memcpy(dstPixel, srcPixel, 4 * sizeof(unsigned char));  // Copy RGBA channels
-}
-
-
-/**
- * @brief Thread function to process a region of the image.
+ * @brief Thread function to process tiles of the image.
+ *
+ * Takes tiles from the focus engine until there are none left (or the program quits), and
+ * blends a window of the best image around every window center of each tile. Once every
+ * tile is blended, it writes the tiles it focused to the output image, with no lock: no
+ * other thread writes them.
  * 
+ * @param imageStack Vector of input images.
  * @param outputImage Output image.
- * @param inputImages Vector of input images.
- * @param startrow Starting row of the region to process.
- * @param endrow Ending row of the region to process.
+ * @param worker Index of the thread.
  */
-void processRegion(std::vector<RasterImage*> imageStack, RasterImage* outputImage, int startRow, int endRow) {
+void processRegion(std::vector<RasterImage*> imageStack, RasterImage* outputImage, unsigned int worker) {
     numLiveFocusingThreads++;
-    int windowSize = 11; 
-
-    std::default_random_engine generator(std::random_device{}());
-    std::uniform_int_distribution<int> distributionRow(startRow, endRow - 1);
-    std::uniform_int_distribution<int> distributionCol(0, outputImage->width - 1);
-
-    while (continue_going) {
-        int centerRow = distributionRow(generator);
-        int centerCol = distributionCol(generator);
-        
-        // Determine regions to lock
-        std::set<std::pair<int, int>> uniqueRegions;
-        for (int i = -windowSize / 2; i <= windowSize / 2; ++i) {
-            for (int j = -windowSize / 2; j <= windowSize / 2; ++j) {
-                int targetRow = centerRow + i;
-                int targetCol = centerCol + j;
-                if (targetRow >= startRow && targetRow < endRow && targetCol >= 0 && targetCol < outputImage->width) {
-                    int regionRow = targetRow / (outputImage->height / GRID_ROWS);
-                    int regionCol = targetCol / (outputImage->width / GRID_COLS);
-                    uniqueRegions.insert({regionRow, regionCol});
-                }
-            }
-        }
 
-         // Create a vector of mutex pointers and sort them
-        std::vector<std::mutex*> mutexesToLock;
-        for (const auto& region : uniqueRegions) {
-            mutexesToLock.push_back(&gridMutexes[region.first][region.second]);
-        }
-        std::sort(mutexesToLock.begin(), mutexesToLock.end());
+    FocusTile tile;
+    std::vector<FocusTile> ownTiles;
+    std::vector<FocusWindow> windows;
+    while (continue_going && focusEngine->nextTile(worker, tile)) {
+        focusEngine->measureContrast(tile);
+        focusEngine->selectWindows(tile, BLEND_WINDOW_SIZE, windows);
 
-        // Lock the mutexes in sorted order
-        for (auto& mutexPtr : mutexesToLock) {
-            mutexPtr->lock();
+        // Into the buffer of the tile, which no other thread writes
+        for (const FocusWindow& window : windows) {
+            windowBlender->add(tile, window, imageStack[window.bestImage]);
         }
+        windowBlender->tileDone();
+        ownTiles.push_back(tile);
+    }
 
-
-        double highestContrast = -1.0;
-        RasterImage* bestImage = nullptr;
-
-        // Calculate contrast and find best image
-        for (auto& img : imageStack) {
-            double contrast = calculateWindowContrast(img, centerRow, centerCol, windowSize);
-            if (contrast > highestContrast) {
-                highestContrast = contrast;
-                bestImage = img;
-            }
-        }
-
-        // Lock for writing to the output image
-        if (bestImage) {
-            std::lock_guard<std::mutex> guard(imageMutex);
-            // Write or blend pixels from the best image to the output image
-            for (int i = -windowSize / 2; i <= windowSize / 2; ++i) {
-                for (int j = -windowSize / 2; j <= windowSize / 2; ++j) {
-                    unsigned int targetRow = centerRow + i;
-                    unsigned int targetCol = centerCol + j;
-                    if (targetRow >= 0 && targetRow < outputImage->height && targetCol >= 0 && targetCol < outputImage->width) {
-                        unsigned char* dstPixel = static_cast<unsigned char*>(outputImage->raster) + (targetRow * outputImage->width + targetCol) * 4;
-                        if (dstPixel[0] == 0 && dstPixel[1] == 0 && dstPixel[2] == 0) { // If pixel is black (0xFF000000)
-                            copyPixel(bestImage, outputImage, targetRow, targetCol);
-                        } else {
-                            // Blend the colors (simple average)
-                            unsigned char* srcPixel = static_cast<unsigned char*>(bestImage->raster) + (targetRow * bestImage->width + targetCol) * 4;
-                            for (int k = 0; k < 3; ++k) { // For R, G, B channels
-                                dstPixel[k] = static_cast<unsigned char>(0.5 * srcPixel[k] + 0.5 * dstPixel[k]);
-                            }
-                        }
-                    }
-                }
-            }
-
-        }
-        for (auto& mutexPtr : mutexesToLock) {
-            mutexPtr->unlock();
+    // Windows spill into the neighboring tiles, so the tiles are written once all are blended
+    if (windowBlender->waitForAllTiles(continue_going)) {
+        for (const FocusTile& ownTile : ownTiles) {
+            windowBlender->compose(ownTile, outputImage);
         }
     }
 
@@ -462,6 +423,14 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
         }
     }
 
+    // Convert every image to gray once; the focusing threads compute the contrast maps, a tile at a time
+    for (auto img : images) {
+        RasterImage* plane = convertToGrayPlane(img);
+        RasterImage* contrastMap = new RasterImage(plane->width, plane->height, GRAY_RASTER);
+        grayPlanes.push_back(plane);
+        contrastMaps.push_back(contrastMap);
+    }
+
      if (!images.empty()) {
         imageOut = new RasterImage(images[0]->width, images[0]->height, RGBA32_RASTER);
     }
@@ -484,43 +453,73 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
  */
 
 int main(int argc, char** argv) {
+    // Options (--headless, --window <size>) come before the other arguments
+    int firstArg = 1;
+    while (firstArg < argc && strncmp(argv[firstArg], "--", 2) == 0) {
+        if (strcmp(argv[firstArg], "--headless") == 0) {
+            headless = true;
+            firstArg++;
+        } else if (strcmp(argv[firstArg], "--window") == 0 && firstArg + 1 < argc) {
+            contrastWindowSize = std::atoi(argv[firstArg + 1]);
+            firstArg += 2;
+        } else {
+            std::cerr << "Unknown option: " << argv[firstArg] << std::endl;
+            return 1;
+        }
+    }
+
     // Check if enough arguments are provided
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <numThreads> <outputPath> <inputPaths...>" << std::endl;
+    if (argc - firstArg < 3) {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--window <size>] <numThreads> <outputPath> <inputPaths...>" << std::endl;
+        return 1;
+    }
+
+    // The contrast window is centered on its pixel
+    if (contrastWindowSize <= 0 || contrastWindowSize % 2 == 0) {
+        std::cerr << "Invalid contrast window size (must be odd): " << contrastWindowSize << std::endl;
         return 1;
     }
 
     // Parse the number of threads
-    int numThreads = std::atoi(argv[1]);
+    int numThreads = std::atoi(argv[firstArg]);
     if (numThreads <= 0) {
         std::cerr << "Invalid number of threads: " << numThreads << std::endl;
         return 1;
     }
 
     // Store the output path
-    outputPath = argv[2];
+    outputPath = argv[firstArg + 1];
 
     // Store the input image paths
     std::vector<std::string> inputPaths;
-    for (int i = 3; i < argc; ++i) {
+    for (int i = firstArg + 2; i < argc; ++i) {
         inputPaths.push_back(argv[i]);
     }
 
 
+    auto loadStart = std::chrono::steady_clock::now();
+
      // Initialize the application and load images
     initializeApplication(inputPaths, outputPath);
 
-    // Initialize the front-end (GUI)
-    initializeFrontEnd(argc, argv, imageOut);
+    // Initialize the front-end (GUI), unless running headless
+    if (!headless) {
+        initializeFrontEnd(argc, argv, imageOut);
+    }
+
+    auto focusStart = std::chrono::steady_clock::now();
 
 
 
-    int rowsPerThread = imageOut->height / numThreads;
+    focusEngine = new FocusEngine(grayPlanes, contrastMaps, contrastWindowSize, numThreads);
+    windowBlender = new WindowBlender(*focusEngine, BLEND_WINDOW_SIZE);
 
     for (int i = 0; i < numThreads; ++i) {
-        int startRow = i * rowsPerThread;
-        int endRow = (i == numThreads - 1) ? imageOut->height : startRow + rowsPerThread;
-        threads.emplace_back(processRegion, std::ref(images), imageOut, startRow, endRow); // Pass start and end rows
+        threads.emplace_back(processRegion, std::ref(images), imageOut, i); // Pass the index of the thread
+    }
+
+    if (headless) {
+        finishHeadless(loadStart, focusStart);
     }
 
     // Start the GLUT main loop
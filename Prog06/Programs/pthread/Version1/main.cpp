@@ -19,8 +19,12 @@
 #include <cstdlib>
 #include <time.h>
 #include <atomic>
+#include <chrono>
 #include "gl_frontEnd.h"
 #include "ImageIO_TGA.h"
+#include "GrayPlane.h"
+#include "ContrastMap.h"
+#include "FocusEngine.h"
 
 using namespace std;
 
@@ -64,6 +68,26 @@ RasterImage* imageOut;
  */
 std::vector<RasterImage*> images;
 
+/**
+ * @brief Gray planes of the input images (in the same order), converted once when the images are loaded.
+ */
+std::vector<RasterImage*> grayPlanes;
+
+/**
+ * @brief Contrast maps of the input images (in the same order).
+ */
+std::vector<RasterImage*> contrastMaps;
+
+/**
+ * @brief Side of the window over which the contrast of a pixel is measured (--window, odd).
+ */
+int contrastWindowSize = 5;
+
+/**
+ * @brief Hands out the tiles of the output image to the focusing threads.
+ */
+FocusEngine* focusEngine;
+
 
 /**
  * @brief Random device for generating random numbers.
@@ -101,28 +125,32 @@ string outputPath;
  */
 std::vector<pthread_t> threads;
 
+/**
+ * @brief True when running without the GUI (--headless): the output image is saved
+ * as soon as the focusing is done, and the program exits.
+ */
+bool headless = false;
+
 /**
  * @struct ThreadData
  * @brief Holds arguments and data for each thread in the image processing application.
  *
  * This structure contains the necessary information for each thread to process a portion 
  * of the image stack. It includes a collection of input images, a pointer to the output image,
- * and the start and end rows that define the specific region of the image each thread will process.
+ * and the index of the thread, which it asks the focus engine for tiles with.
  *
  * @param images A vector of pointers to RasterImage objects representing the input images.
  * @param outputImage A pointer to the RasterImage object representing the output image.
- * @param startRow The starting row index of the image segment that the thread will process.
- * @param endRow The ending row index of the image segment that the thread will process.
+ * @param worker The index of the thread (0 to numThreads - 1).
  */
 
 struct ThreadData {
     std::vector<RasterImage*> images;
     RasterImage* outputImage;
-    int startRow;
-    int endRow;
+    unsigned int worker;
     // Constructor to initialize members
-    ThreadData(std::vector<RasterImage*> images, RasterImage* outImg, int sRow, int eRow) 
-        : images(images), outputImage(outImg), startRow(sRow), endRow(eRow) {}
+    ThreadData(std::vector<RasterImage*> images, RasterImage* outImg, unsigned int worker) 
+        : images(images), outputImage(outImg), worker(worker) {}
 };
 
 
@@ -217,10 +245,67 @@ void cleanupAndQuit(void)
     }
     images.clear();
 
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+
     // Exit the program
     exit(0);
 }
 
+/**
+ * @brief Waits for the focusing threads, then saves the output image, reports the
+ * timings and exits (headless mode).
+ *
+ * @param loadStart Time at which the input images started loading.
+ * @param focusStart Time at which the focusing threads were started.
+ */
+void finishHeadless(std::chrono::steady_clock::time_point loadStart, std::chrono::steady_clock::time_point focusStart)
+{
+    for (auto& thread : threads) {
+        pthread_join(thread, NULL);
+    }
+    auto focusEnd = std::chrono::steady_clock::now();
+
+    writeTGA(outputPath.c_str(), imageOut);
+    auto saveEnd = std::chrono::steady_clock::now();
+
+    auto milliseconds = [](auto begin, auto end) {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    };
+    printf("Focused %zu images of %ux%u with %zu threads\n", images.size(), imageOut->width, imageOut->height,
+           threads.size());
+    printf("Load: %.3f ms, focus: %.3f ms, save: %.3f ms\n", milliseconds(loadStart, focusStart),
+           milliseconds(focusStart, focusEnd), milliseconds(focusEnd, saveEnd));
+
+    for (int k = 0; k < MAX_NUM_MESSAGES; k++) {
+        free(message[k]);
+    }
+    free(message);
+    for (auto& img : images) {
+        delete img;
+    }
+    images.clear();
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete imageOut;
+
+    exit(0);
+}
+
 /**
  * @brief Handles keyboard events.
  *
@@ -258,53 +343,6 @@ void handleKeyboardEvent(unsigned char c, int x, int y)
 }
 
 
-/**
- * @brief Converts a pixel to grayscale.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the pixel.
- * @param col The column of the pixel.
- * @return The grayscale value of the pixel.
- */
-double convertToGrayscale(RasterImage* image, int row, int col) {
-    if (image->type == RGBA32_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col) * 4;
-        // Using a weighted average for human perception: 0.21 R + 0.72 G + 0.07 B
-        return 0.21 * pixel[0] + 0.72 * pixel[1] + 0.07 * pixel[2];
-    }
-    else if (image->type == GRAY_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col);
-        return *pixel;
-    }
-    return 0;
-}
-
-/**
- * @brief Calculates the contrast of a window around a pixel.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the central pixel of the window.
- * @param col The column of the central pixel of the window.
- * @return The contrast value.
- */
-double calculateWindowContrast(RasterImage* image, int row, int col) {
-    double minGray = 255.0, maxGray = 0.0;
-
-    for (int i = -2; i <= 2; i++) {
-        for (int j = -2; j <= 2; j++) {
-            int neighborRow = row + i;
-            int neighborCol = col + j;
-            if (neighborRow >= 0 && neighborRow < image->height && neighborCol >= 0 && neighborCol < image->width) {
-                double gray = convertToGrayscale(image, neighborRow, neighborCol);
-                minGray = std::min(minGray, gray);
-                maxGray = std::max(maxGray, gray);
-            }
-        }
-    }
-
-    return maxGray - minGray; // Contrast is the range of grayscale values
-}
-
 /**
 /**
  * @brief Copies a pixel from one image to another.
@@ -327,35 +365,26 @@ void copyPixel(RasterImage* srcImage, RasterImage* dstImage, int row, int col) {
  * @brief Thread function for processing a region of the image.
  * 
  * This function is designed to be compatible with POSIX threads (pthread).
- * It processes a part of the image focusing task by operating on a specific region of the image.
+ * It takes tiles of the output image from the focus engine until there are none left,
+ * and copies every pixel of a tile from the input image with the most contrast there.
  * 
- * @param arg Pointer to ThreadData containing necessary information for processing.
- * @return Returns nullptr after completion.
+ * @param inputImages Vector of input images.
+ * @param outputImage Output image.
+ * @param worker Index of the thread.
  */
-
-
-
-
-void processRegion(std::vector<RasterImage*> inputImages, RasterImage* outputImage, int startRow, int endRow) {
+void processRegion(std::vector<RasterImage*> inputImages, RasterImage* outputImage, unsigned int worker) {
      numLiveFocusingThreads++;
 
-    for (unsigned int row = startRow; row < endRow; ++row) {
-        for (unsigned int col = 0; col < outputImage->width; ++col) {
-            double highestContrast = -1.0;
-            RasterImage* bestImage = nullptr;
-
-            for (auto& img : inputImages) {
-                if (img) {
-                    double contrast = calculateWindowContrast(img, row, col);
-                    if (contrast > highestContrast) {
-                        highestContrast = contrast;
-                        bestImage = img;
-                    }
-                }
-            }
+    FocusTile tile;
+    std::vector<unsigned char> bestImages;
+    while (focusEngine->nextTile(worker, tile)) {
+        focusEngine->measureContrast(tile);
+        focusEngine->selectPixels(tile, bestImages);
 
-            if (bestImage) {
-                copyPixel(bestImage, outputImage, row, col);
+        size_t pixel = 0;
+        for (unsigned int row = tile.firstRow; row < tile.endRow; ++row) {
+            for (unsigned int col = 0; col < outputImage->width; ++col) {
+                copyPixel(inputImages[bestImages[pixel++]], outputImage, row, col);
             }
         }
     }
@@ -378,7 +407,7 @@ void processRegion(std::vector<RasterImage*> inputImages, RasterImage* outputIma
  */
 void* processRegionThreader(void* arg) {
     ThreadData* data = static_cast<ThreadData*>(arg);
-    processRegion(data->images, data->outputImage, data->startRow, data->endRow);
+    processRegion(data->images, data->outputImage, data->worker);
     delete data; // Don't forget to free the memory
     return NULL;
 }
@@ -409,6 +438,16 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
         }
     }
 
+    // Convert every image to gray once, for all the contrast computations
+    for (auto img : images) {
+        grayPlanes.push_back(convertToGrayPlane(img));
+    }
+
+    // The focusing threads compute the contrast maps, a tile at a time
+    for (auto plane : grayPlanes) {
+        contrastMaps.push_back(new RasterImage(plane->width, plane->height, GRAY_RASTER));
+    }
+
      if (!images.empty()) {
         imageOut = new RasterImage(images[0]->width, images[0]->height, RGBA32_RASTER);
     }
@@ -432,49 +471,76 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
  */
 
 int main(int argc, char** argv) {
+    // Options (--headless, --window <size>) come before the other arguments
+    int firstArg = 1;
+    while (firstArg < argc && strncmp(argv[firstArg], "--", 2) == 0) {
+        if (strcmp(argv[firstArg], "--headless") == 0) {
+            headless = true;
+            firstArg++;
+        } else if (strcmp(argv[firstArg], "--window") == 0 && firstArg + 1 < argc) {
+            contrastWindowSize = std::atoi(argv[firstArg + 1]);
+            firstArg += 2;
+        } else {
+            std::cerr << "Unknown option: " << argv[firstArg] << std::endl;
+            return 1;
+        }
+    }
+
     // Check if enough arguments are provided
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <numThreads> <outputPath> <inputPaths...>" << std::endl;
+    if (argc - firstArg < 3) {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--window <size>] <numThreads> <outputPath> <inputPaths...>" << std::endl;
+        return 1;
+    }
+
+    // The contrast window is centered on its pixel
+    if (contrastWindowSize <= 0 || contrastWindowSize % 2 == 0) {
+        std::cerr << "Invalid contrast window size (must be odd): " << contrastWindowSize << std::endl;
         return 1;
     }
 
     // Parse the number of threads
-    int numThreads = std::atoi(argv[1]);
+    int numThreads = std::atoi(argv[firstArg]);
     if (numThreads <= 0) {
         std::cerr << "Invalid number of threads: " << numThreads << std::endl;
         return 1;
     }
 
     // Store the output path
-    outputPath = argv[2];
+    outputPath = argv[firstArg + 1];
 
     // Store the input image paths
     std::vector<std::string> inputPaths;
-    for (int i = 3; i < argc; ++i) {
+    for (int i = firstArg + 2; i < argc; ++i) {
         inputPaths.push_back(argv[i]);
     }
 
 
+    auto loadStart = std::chrono::steady_clock::now();
+
      // Initialize the application and load images
     initializeApplication(inputPaths, outputPath);
 
-    // Initialize the front-end (GUI)
-    initializeFrontEnd(argc, argv, imageOut);
-
+    // Initialize the front-end (GUI), unless running headless
+    if (!headless) {
+        initializeFrontEnd(argc, argv, imageOut);
+    }
 
+    auto focusStart = std::chrono::steady_clock::now();
 
-int rowsPerThread = imageOut->height / numThreads;
+    focusEngine = new FocusEngine(grayPlanes, contrastMaps, contrastWindowSize, numThreads);
 
-    threads.resize(numThreads);
+    threads.reserve(numThreads);
     for (int i = 0; i < numThreads; ++i) {
-        int startRow = i * rowsPerThread;
-        int endRow = (i == numThreads - 1) ? imageOut->height : startRow + rowsPerThread;
         pthread_t thread;
-        ThreadData* data = new ThreadData(images, imageOut, startRow, endRow);
+        ThreadData* data = new ThreadData(images, imageOut, i);
         pthread_create(&thread, NULL, &processRegionThreader, data);
         threads.push_back(thread);
     }
 
+    if (headless) {
+        finishHeadless(loadStart, focusStart);
+    }
+
 // Start the GLUT main loop
 glutMainLoop();
 
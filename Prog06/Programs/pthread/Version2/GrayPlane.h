@@ -0,0 +1,18 @@
+#ifndef GRAY_PLANE_H
+#define GRAY_PLANE_H
+
+#include "RasterImage.h"
+
+/**
+ * @brief Converts an image into an 8-bit gray plane (a GRAY_RASTER image of the same size).
+ *
+ * Color pixels are weighted for human perception, 0.21 R + 0.72 G + 0.07 B, in 8-bit fixed
+ * point ((54 R + 184 G + 18 B + 128) / 256), 16 pixels at a time where SSE2 is available.
+ * Gray images are copied as they are.
+ *
+ * @param image The image to convert (RGBA32_RASTER or GRAY_RASTER).
+ * @return A new gray image, to be deleted by the caller.
+ */
+RasterImage* convertToGrayPlane(const RasterImage* image);
+
+#endif // GRAY_PLANE_H
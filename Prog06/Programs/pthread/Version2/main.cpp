@@ -11,7 +11,7 @@
  *
  * Key features:
  * - Multithreaded processing of image stacks.
- * - Region-based locking for thread synchronization.
+ * - Lock-free composition of the output image, each thread writing the tiles it focused.
  * - Dynamic allocation of thread-specific data.
  * - Implementation of pthreads for concurrent processing.
  * - Utilization of atomic variables for thread-safe operations.
@@ -29,8 +29,12 @@
 #include <cstdlib>
 #include <time.h>
 #include <atomic>
+#include <chrono>
 #include "gl_frontEnd.h"
 #include "ImageIO_TGA.h"
+#include "GrayPlane.h"
+#include "ContrastMap.h"
+#include "FocusEngine.h"
 
 using namespace std;
 
@@ -74,6 +78,36 @@ RasterImage* imageOut;
  */
 std::vector<RasterImage*> images;
 
+/**
+ * @brief Gray planes of the input images (in the same order), converted once when the images are loaded.
+ */
+std::vector<RasterImage*> grayPlanes;
+
+/**
+ * @brief Contrast maps of the input images (in the same order).
+ */
+std::vector<RasterImage*> contrastMaps;
+
+/**
+ * @brief Side of the window over which the contrast of a pixel is measured (--window, odd).
+ */
+int contrastWindowSize = 5;
+
+/**
+ * @brief Side of the windows blended into the output image.
+ */
+const int BLEND_WINDOW_SIZE = 11;
+
+/**
+ * @brief Hands out the tiles of the output image to the focusing threads.
+ */
+FocusEngine* focusEngine;
+
+/**
+ * @brief Blends the windows of the focusing threads into the output image, a buffer per tile.
+ */
+WindowBlender* windowBlender;
+
 
 /**
  * @brief Random device for generating random numbers.
@@ -124,17 +158,16 @@ int numThreads;
 
 
 /**
- * @brief Array of mutexes for the grid, used for region-based locking in image processing.
+ * @brief Flag to control the ongoing operations of threads.
  */
 
-
-pthread_mutex_t imageMutex = PTHREAD_MUTEX_INITIALIZER;
+std::atomic<bool> continue_going(true);  // Global variable
 
 /**
- * @brief Flag to control the ongoing operations of threads.
+ * @brief True when running without the GUI (--headless): once the threads have focused
+ * every tile, the output image is saved and the program exits.
  */
-
-std::atomic<bool> continue_going(true);  // Global variable
+bool headless = false;
 
 
 /**
@@ -237,12 +270,70 @@ void cleanupAndQuit(void) {
 
     // No need to delete the threads vector
 
-    pthread_mutex_destroy(&imageMutex);
+
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
 
     // Exit the program
     exit(0);
 }
 
+/**
+ * @brief Waits for the focusing threads, then saves the output image, reports the
+ * timings and exits (headless mode).
+ *
+ * @param loadStart Time at which the input images started loading.
+ * @param focusStart Time at which the focusing threads were started.
+ */
+void finishHeadless(std::chrono::steady_clock::time_point loadStart, std::chrono::steady_clock::time_point focusStart)
+{
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    auto focusEnd = std::chrono::steady_clock::now();
+
+    writeTGA(outputPath.c_str(), imageOut);
+    auto saveEnd = std::chrono::steady_clock::now();
+
+    auto milliseconds = [](auto begin, auto end) {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    };
+    printf("Focused %zu images of %ux%u with %d threads\n", images.size(), imageOut->width, imageOut->height,
+           numThreads);
+    printf("Load: %.3f ms, focus: %.3f ms, save: %.3f ms\n", milliseconds(loadStart, focusStart),
+           milliseconds(focusStart, focusEnd), milliseconds(focusEnd, saveEnd));
+
+    for (int k = 0; k < MAX_NUM_MESSAGES; k++) {
+        free(message[k]);
+    }
+    free(message);
+    for (auto& img : images) {
+        delete img;
+    }
+    images.clear();
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
+    delete imageOut;
+
+    exit(0);
+}
+
 /**
  * @brief Handles keyboard events.
  *
@@ -280,77 +371,20 @@ void handleKeyboardEvent(unsigned char c, int x, int y)
 }
 
 
-/**
- * @brief Converts a pixel to grayscale.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the pixel.
- * @param col The column of the pixel.
- * @return The grayscale value of the pixel.
- */
-double convertToGrayscale(RasterImage* image, int row, int col) {
-    if (image->type == RGBA32_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col) * 4;
-        // Using a weighted average for human perception: 0.21 R + 0.72 G + 0.07 B
-        return 0.21 * pixel[0] + 0.72 * pixel[1] + 0.07 * pixel[2];
-    }
-    else if (image->type == GRAY_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col);
-        return *pixel;
-    }
-    return 0;
-}
-
-/**
- * @brief Calculates the contrast of a window around a pixel.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the central pixel of the window.
- * @param col The column of the central pixel of the window.
- * @return The contrast value.
- */
-double calculateWindowContrast(RasterImage* image, int row, int col, int windowSize){
-    double minGray = 255.0, maxGray = 0.0;
-
-    for (int i = -2; i <= 2; i++) {
-        for (int j = -2; j <= 2; j++) {
-            int neighborRow = row + i;
-            int neighborCol = col + j;
-            if (neighborRow >= 0 && neighborRow < image->height && neighborCol >= 0 && neighborCol < image->width) {
-                double gray = convertToGrayscale(image, neighborRow, neighborCol);
-                minGray = std::min(minGray, gray);
-                maxGray = std::max(maxGray, gray);
-            }
-        }
-    }
-
-    return maxGray - minGray; // Contrast is the range of grayscale values
-}
-
-/**
-/**
- * @brief Copies a pixel from one image to another.
- * 
- * @param srcImage Source image.
- * @param dstImage Destination image.
- * @param row Row of the pixel to copy.
- * @param col Column of the pixel to copy.
- */
-
-void copyPixel(RasterImage* srcImage, RasterImage* dstImage, int row, int col) {
-    unsigned char* srcPixel = static_cast<unsigned char*>(srcImage->raster) + (row * srcImage->width + col) * 4;
-    unsigned char* dstPixel = static_cast<unsigned char*>(dstImage->raster) + (row * dstImage->width + col) * 4;
-
-    memcpy(dstPixel, srcPixel, 4 * sizeof(unsigned char));  // Copy RGBA channels
-}
-
-
-
 struct ThreadData {
     std::vector<RasterImage*> images;
     RasterImage* outputImage;
+    unsigned int worker;
 };
 
+/**
+ * @brief Thread function: takes tiles from the focus engine until there are none left
+ * (or the program quits), and blends a window of the best image around every window
+ * center of each tile; then, once every tile is blended, writes its own tiles to the output image.
+ *
+ * @param arg Pointer to the ThreadData of the thread.
+ * @return Returns NULL after completion.
+ */
 void* processRegion(void* arg) {
     ThreadData* data = static_cast<ThreadData*>(arg);
     std::vector<RasterImage*>& imageStack = data->images;
@@ -358,50 +392,25 @@ void* processRegion(void* arg) {
 
     numLiveFocusingThreads++;
 
-    std::default_random_engine generator(std::random_device{}());
-    std::uniform_int_distribution<int> distributionRow(0, outputImage->height - 1);
-    std::uniform_int_distribution<int> distributionCol(0, outputImage->width - 1);
-    int windowSize = 11; // Or 13 as per your requirement
-
-    while (continue_going) {
-        int centerRow = distributionRow(generator);  // Random row
-        int centerCol = distributionCol(generator);  // Random column
-
-        double highestContrast = -1.0;
-        RasterImage* bestImage = nullptr;
-
-        // Calculate contrast and find best image
-        for (auto& img : imageStack) {
-            double contrast = calculateWindowContrast(img, centerRow, centerCol, windowSize);
-            if (contrast > highestContrast) {
-                highestContrast = contrast;
-                bestImage = img;
-            }
+    FocusTile tile;
+    std::vector<FocusTile> ownTiles;
+    std::vector<FocusWindow> windows;
+    while (continue_going && focusEngine->nextTile(data->worker, tile)) {
+        focusEngine->measureContrast(tile);
+        focusEngine->selectWindows(tile, BLEND_WINDOW_SIZE, windows);
+
+        // Into the buffer of the tile, which no other thread writes
+        for (const FocusWindow& window : windows) {
+            windowBlender->add(tile, window, imageStack[window.bestImage]);
         }
+        windowBlender->tileDone();
+        ownTiles.push_back(tile);
+    }
 
-        // Lock for writing to the output image
-        if (bestImage) {
-            pthread_mutex_lock(&imageMutex);
-            // Write or blend pixels from the best image to the output image
-            for (int i = -windowSize / 2; i <= windowSize / 2; ++i) {
-                for (int j = -windowSize / 2; j <= windowSize / 2; ++j) {
-                    unsigned int targetRow = centerRow + i;
-                    unsigned int targetCol = centerCol + j;
-                    if (targetRow >= 0 && targetRow < outputImage->height && targetCol >= 0 && targetCol < outputImage->width) {
-                        unsigned char* dstPixel = static_cast<unsigned char*>(outputImage->raster) + (targetRow * outputImage->width + targetCol) * 4;
-                        if (dstPixel[0] == 0 && dstPixel[1] == 0 && dstPixel[2] == 0) { // If pixel is black (0xFF000000)
-                            copyPixel(bestImage, outputImage, targetRow, targetCol);
-                        } else {
-                            // Blend the colors (simple average)
-                            unsigned char* srcPixel = static_cast<unsigned char*>(bestImage->raster) + (targetRow * bestImage->width + targetCol) * 4;
-                            for (int k = 0; k < 3; ++k) { // For R, G, B channels
-                                dstPixel[k] = static_cast<unsigned char>(0.5 * srcPixel[k] + 0.5 * dstPixel[k]);
-                            }
-                        }
-                    }
-                }
-            }
-            pthread_mutex_unlock(&imageMutex);
+    // Windows spill into the neighboring tiles, so the tiles are written once all are blended
+    if (windowBlender->waitForAllTiles(continue_going)) {
+        for (const FocusTile& ownTile : ownTiles) {
+            windowBlender->compose(ownTile, outputImage);
         }
     }
 
@@ -437,6 +446,14 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
         }
     }
 
+    // Convert every image to gray once; the focusing threads compute the contrast maps, a tile at a time
+    for (auto img : images) {
+        RasterImage* plane = convertToGrayPlane(img);
+        RasterImage* contrastMap = new RasterImage(plane->width, plane->height, GRAY_RASTER);
+        grayPlanes.push_back(plane);
+        contrastMaps.push_back(contrastMap);
+    }
+
      if (!images.empty()) {
         imageOut = new RasterImage(images[0]->width, images[0]->height, RGBA32_RASTER);
     }
@@ -460,43 +477,77 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
  */
 
 int main(int argc, char** argv) {
+    // Options (--headless, --window <size>) come before the other arguments
+    int firstArg = 1;
+    while (firstArg < argc && strncmp(argv[firstArg], "--", 2) == 0) {
+        if (strcmp(argv[firstArg], "--headless") == 0) {
+            headless = true;
+            firstArg++;
+        } else if (strcmp(argv[firstArg], "--window") == 0 && firstArg + 1 < argc) {
+            contrastWindowSize = std::atoi(argv[firstArg + 1]);
+            firstArg += 2;
+        } else {
+            std::cerr << "Unknown option: " << argv[firstArg] << std::endl;
+            return 1;
+        }
+    }
+
     // Check if enough arguments are provided
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <numThreads> <outputPath> <inputPaths...>" << std::endl;
+    if (argc - firstArg < 3) {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--window <size>] <numThreads> <outputPath> <inputPaths...>" << std::endl;
+        return 1;
+    }
+
+    // The contrast window is centered on its pixel
+    if (contrastWindowSize <= 0 || contrastWindowSize % 2 == 0) {
+        std::cerr << "Invalid contrast window size (must be odd): " << contrastWindowSize << std::endl;
         return 1;
     }
 
     // Parse the number of threads
-    numThreads = std::atoi(argv[1]);
+    numThreads = std::atoi(argv[firstArg]);
     if (numThreads <= 0) {
         std::cerr << "Invalid number of threads: " << numThreads << std::endl;
         return 1;
     }
 
     // Store the output path
-    outputPath = argv[2];
+    outputPath = argv[firstArg + 1];
 
     // Store the input image paths
     std::vector<std::string> inputPaths;
-    for (int i = 3; i < argc; ++i) {
+    for (int i = firstArg + 2; i < argc; ++i) {
         inputPaths.push_back(argv[i]);
     }
 
 
+    auto loadStart = std::chrono::steady_clock::now();
+
      // Initialize the application and load images
     initializeApplication(inputPaths, outputPath);
 
-    // Initialize the front-end (GUI)
-    initializeFrontEnd(argc, argv, imageOut);
+    // Initialize the front-end (GUI), unless running headless
+    if (!headless) {
+        initializeFrontEnd(argc, argv, imageOut);
+    }
+
+    auto focusStart = std::chrono::steady_clock::now();
+
 
 
+    focusEngine = new FocusEngine(grayPlanes, contrastMaps, contrastWindowSize, numThreads);
+    windowBlender = new WindowBlender(*focusEngine, BLEND_WINDOW_SIZE);
 
     threads.resize(numThreads);
     for (int i = 0; i < numThreads; ++i) {
-        ThreadData* data = new ThreadData{images, imageOut};
+        ThreadData* data = new ThreadData{images, imageOut, static_cast<unsigned int>(i)};
         pthread_create(&threads[i], NULL, processRegion, data);
     }
 
+    if (headless) {
+        finishHeadless(loadStart, focusStart);
+    }
+
     glutMainLoop();
 
 
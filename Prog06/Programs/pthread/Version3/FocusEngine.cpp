@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <thread>
+
+#include "ContrastMap.h"
+#include "FocusEngine.h"
+
+/**
+ * @brief Rows per tile, at least (more for large contrast windows, whose rows spill into
+ * the neighboring tiles).
+ */
+const unsigned int TILE_ROWS = 32;
+
+static uint64_t packRange(uint32_t front, uint32_t back)
+{
+    return (static_cast<uint64_t>(back) << 32) | front;
+}
+
+static uint32_t rangeFront(uint64_t bounds)
+{
+    return static_cast<uint32_t>(bounds);
+}
+
+static uint32_t rangeBack(uint64_t bounds)
+{
+    return static_cast<uint32_t>(bounds >> 32);
+}
+
+TileQueue::TileQueue(unsigned int numTiles, unsigned int numWorkers)
+    : numWorkers(numWorkers),
+      ranges(new Range[numWorkers])
+{
+    for (unsigned int worker = 0; worker < numWorkers; worker++) {
+        uint32_t front = static_cast<uint64_t>(numTiles) * worker / numWorkers;
+        uint32_t back = static_cast<uint64_t>(numTiles) * (worker + 1) / numWorkers;
+        ranges[worker].bounds.store(packRange(front, back));
+    }
+}
+
+bool TileQueue::next(unsigned int worker, unsigned int& tile)
+{
+    // From the front of the worker's own range
+    std::atomic<uint64_t>& own = ranges[worker].bounds;
+    uint64_t bounds = own.load();
+    while (rangeFront(bounds) < rangeBack(bounds)) {
+        if (own.compare_exchange_weak(bounds, packRange(rangeFront(bounds) + 1, rangeBack(bounds)))) {
+            tile = rangeFront(bounds);
+            return true;
+        }
+    }
+
+    // Else from the back half of the largest range left
+    for (;;) {
+        unsigned int victim = numWorkers;
+        uint32_t mostLeft = 0;
+        for (unsigned int other = 0; other < numWorkers; other++) {
+            uint64_t otherBounds = ranges[other].bounds.load();
+            uint32_t left = rangeBack(otherBounds) - std::min(rangeFront(otherBounds), rangeBack(otherBounds));
+            if (left > mostLeft) {
+                mostLeft = left;
+                victim = other;
+            }
+        }
+        if (victim == numWorkers) {
+            return false;
+        }
+
+        uint64_t victimBounds = ranges[victim].bounds.load();
+        uint32_t front = rangeFront(victimBounds);
+        uint32_t back = rangeBack(victimBounds);
+        if (front >= back) {
+            continue;
+        }
+        uint32_t middle = front + (back - front) / 2;
+        if (ranges[victim].bounds.compare_exchange_strong(victimBounds, packRange(front, middle))) {
+            // The worker's own range is empty, so nobody else writes it
+            own.store(packRange(middle + 1, back));
+            tile = middle;
+            return true;
+        }
+    }
+}
+
+FocusEngine::FocusEngine(const std::vector<RasterImage*>& grayPlanes, const std::vector<RasterImage*>& contrastMaps,
+                         int contrastWindowSize, unsigned int numWorkers)
+    : grayPlanes(grayPlanes),
+      contrastMaps(contrastMaps),
+      contrastWindowSize(contrastWindowSize),
+      width(grayPlanes.empty() ? 0 : grayPlanes[0]->width),
+      height(grayPlanes.empty() ? 0 : grayPlanes[0]->height),
+      tileRows(std::max(TILE_ROWS, 4 * static_cast<unsigned int>(contrastWindowSize))),
+      tileCount((height + tileRows - 1) / tileRows),
+      queue(tileCount, numWorkers)
+{
+}
+
+FocusTile FocusEngine::tile(unsigned int index) const
+{
+    return {index, index * tileRows, std::min(height, (index + 1) * tileRows)};
+}
+
+bool FocusEngine::nextTile(unsigned int worker, FocusTile& tile)
+{
+    unsigned int index;
+    if (!queue.next(worker, index)) {
+        return false;
+    }
+    tile = this->tile(index);
+    return true;
+}
+
+void FocusEngine::measureContrast(const FocusTile& tile)
+{
+    for (size_t k = 0; k < grayPlanes.size(); k++) {
+        computeContrastMap(grayPlanes[k], contrastWindowSize, contrastMaps[k], tile.firstRow, tile.endRow);
+    }
+}
+
+void FocusEngine::selectPixels(const FocusTile& tile, std::vector<unsigned char>& bestImages) const
+{
+    const size_t first = static_cast<size_t>(tile.firstRow) * width;
+    const size_t numPixels = static_cast<size_t>(tile.endRow - tile.firstRow) * width;
+    bestImages.assign(numPixels, 0);
+    if (contrastMaps.empty()) {
+        return;
+    }
+
+    // One image at a time, along the rows: a strict improvement takes the pixel
+    std::vector<unsigned char> highestContrast(static_cast<const unsigned char*>(contrastMaps[0]->raster) + first,
+                                               static_cast<const unsigned char*>(contrastMaps[0]->raster) + first + numPixels);
+    for (size_t k = 1; k < contrastMaps.size(); k++) {
+        const unsigned char* contrast = static_cast<const unsigned char*>(contrastMaps[k]->raster) + first;
+        for (size_t pixel = 0; pixel < numPixels; pixel++) {
+            if (contrast[pixel] > highestContrast[pixel]) {
+                highestContrast[pixel] = contrast[pixel];
+                bestImages[pixel] = static_cast<unsigned char>(k);
+            }
+        }
+    }
+}
+
+void FocusEngine::selectWindows(const FocusTile& tile, int windowSize, std::vector<FocusWindow>& windows) const
+{
+    windows.clear();
+    const unsigned int step = windowSize / 2 + 1;
+    const unsigned int firstCenterRow = (tile.firstRow + step - 1) / step * step;
+    for (unsigned int row = firstCenterRow; row < tile.endRow; row += step) {
+        for (unsigned int col = 0; col < width; col += step) {
+            FocusWindow window = {row, col, 0};
+            int highestContrast = -1;
+            for (size_t k = 0; k < contrastMaps.size(); k++) {
+                int contrast = contrastAt(contrastMaps[k], row, col);
+                if (contrast > highestContrast) {
+                    highestContrast = contrast;
+                    window.bestImage = static_cast<unsigned int>(k);
+                }
+            }
+            windows.push_back(window);
+        }
+    }
+}
+
+WindowBlender::WindowBlender(const FocusEngine& engine, int windowSize)
+    : width(engine.imageWidth()),
+      windowSize(windowSize),
+      tileSums(engine.numTiles()),
+      numTilesDone(0)
+{
+    const unsigned int radius = windowSize / 2;
+    for (unsigned int index = 0; index < engine.numTiles(); index++) {
+        FocusTile tile = engine.tile(index);
+        TileSums& buffer = tileSums[index];
+        buffer.firstRow = tile.firstRow > radius ? tile.firstRow - radius : 0;
+        buffer.endRow = std::min(engine.imageHeight(), tile.endRow + radius);
+        const size_t numPixels = static_cast<size_t>(buffer.endRow - buffer.firstRow) * width;
+        buffer.sums.assign(numPixels * 3, 0);
+        buffer.counts.assign(numPixels, 0);
+    }
+}
+
+void WindowBlender::add(const FocusTile& tile, const FocusWindow& window, const RasterImage* image)
+{
+    TileSums& buffer = tileSums[tile.index];
+    const int radius = windowSize / 2;
+    const unsigned int firstRow = std::max(static_cast<int>(buffer.firstRow), static_cast<int>(window.centerRow) - radius);
+    const unsigned int endRow = std::min(buffer.endRow, window.centerRow + radius + 1);
+    const unsigned int firstCol = std::max(0, static_cast<int>(window.centerCol) - radius);
+    const unsigned int endCol = std::min(width, window.centerCol + radius + 1);
+
+    const unsigned char* src = static_cast<const unsigned char*>(image->raster);
+    for (unsigned int row = firstRow; row < endRow; row++) {
+        const unsigned char* srcPixel = src + (static_cast<size_t>(row) * width + firstCol) * 4;
+        const size_t pixel = static_cast<size_t>(row - buffer.firstRow) * width + firstCol;
+        uint32_t* sum = &buffer.sums[pixel * 3];
+        uint16_t* count = &buffer.counts[pixel];
+        for (unsigned int col = firstCol; col < endCol; col++) {
+            sum[0] += srcPixel[0];
+            sum[1] += srcPixel[1];
+            sum[2] += srcPixel[2];
+            (*count)++;
+            srcPixel += 4;
+            sum += 3;
+            count++;
+        }
+    }
+}
+
+void WindowBlender::tileDone()
+{
+    numTilesDone.fetch_add(1, std::memory_order_release);
+}
+
+bool WindowBlender::waitForAllTiles(const std::atomic<bool>& keepGoing) const
+{
+    while (numTilesDone.load(std::memory_order_acquire) < tileSums.size()) {
+        if (!keepGoing) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void WindowBlender::compose(const FocusTile& tile, RasterImage* output) const
+{
+    // The tiles whose windows reach this one
+    unsigned int first = tile.index;
+    unsigned int end = tile.index + 1;
+    while (first > 0 && tileSums[first - 1].endRow > tile.firstRow) {
+        first--;
+    }
+    while (end < tileSums.size() && tileSums[end].firstRow < tile.endRow) {
+        end++;
+    }
+
+    std::vector<uint32_t> sums(static_cast<size_t>(width) * 3);
+    std::vector<uint32_t> counts(width);
+    unsigned char* dst = static_cast<unsigned char*>(output->raster);
+    for (unsigned int row = tile.firstRow; row < tile.endRow; row++) {
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (unsigned int index = first; index < end; index++) {
+            const TileSums& buffer = tileSums[index];
+            if (row < buffer.firstRow || row >= buffer.endRow) {
+                continue;
+            }
+            const size_t offset = static_cast<size_t>(row - buffer.firstRow) * width;
+            for (size_t k = 0; k < sums.size(); k++) {
+                sums[k] += buffer.sums[offset * 3 + k];
+            }
+            for (unsigned int col = 0; col < width; col++) {
+                counts[col] += buffer.counts[offset + col];
+            }
+        }
+
+        unsigned char* dstPixel = dst + static_cast<size_t>(row) * width * 4;
+        for (unsigned int col = 0; col < width; col++, dstPixel += 4) {
+            const uint32_t count = counts[col];
+            if (count == 0) {
+                continue;
+            }
+            for (int channel = 0; channel < 3; channel++) {
+                dstPixel[channel] = static_cast<unsigned char>((sums[col * 3 + channel] + count / 2) / count);
+            }
+            dstPixel[3] = 255;
+        }
+    }
+}
@@ -4,7 +4,9 @@
  * 
  * This file contains the main functionality for Nicholas Faciano's assignment,
  * which involves processing multiple images to produce a single focused image using multithreading.
- * Version 3 of the assignment focuses on using multiple locks for synchronization.
+ * Version 3 runs the same pipeline as Version 2, with no locks: the threads take tiles of the
+ * output image from a work-stealing queue, blend their windows into a buffer per tile, and each
+ * writes the tiles it focused to the output image once every tile is blended.
  *
  * @author Nicholas Faciano
  * @date 12/2/2023
@@ -19,9 +21,13 @@
 #include <cstdlib>
 #include <time.h>
 #include <atomic>
-#include <set>
+#include <chrono>
+#include <algorithm>
 #include "gl_frontEnd.h"
 #include "ImageIO_TGA.h"
+#include "GrayPlane.h"
+#include "ContrastMap.h"
+#include "FocusEngine.h"
 
 using namespace std;
 
@@ -63,15 +69,47 @@ RasterImage* imageOut;
  */
 std::vector<RasterImage*> images;
 
+/**
+ * @brief Gray planes of the input images (in the same order), converted once when the images are loaded.
+ */
+std::vector<RasterImage*> grayPlanes;
+
+/**
+ * @brief Contrast maps of the input images (in the same order).
+ */
+std::vector<RasterImage*> contrastMaps;
+
+/**
+ * @brief Side of the window over which the contrast of a pixel is measured (--window, odd).
+ */
+int contrastWindowSize = 5;
+
+/**
+ * @brief Side of the windows blended into the output image.
+ */
+const int BLEND_WINDOW_SIZE = 11;
+
+/**
+ * @brief Hands out the tiles of the output image to the focusing threads.
+ */
+FocusEngine* focusEngine;
+
+/**
+ * @brief Blends the windows of the focusing threads into the output image, a buffer per tile.
+ */
+WindowBlender* windowBlender;
+
 /**
  * @brief Threads used for processing the image stack.
  */
 pthread_t* threads;
 
+
 /**
- * @brief Mutex for synchronizing access to the output image.
+ * @brief True when running without the GUI (--headless): once the threads have focused
+ * every tile, the output image is saved and the program exits.
  */
-pthread_mutex_t imageMutex = PTHREAD_MUTEX_INITIALIZER;
+bool headless = false;
 
 /**
  * @brief Random device for generating random numbers.
@@ -103,16 +141,6 @@ uniform_int_distribution<unsigned int> colDist;
  */
 string outputPath;
 
-/**
- * @brief Number of rows in the grid for locking regions of the image.
- */
-const int GRID_ROWS = 4; // For example, if you want 16 locks, you could create a 4x4 grid
-
-/**
- * @brief Number of columns in the grid for locking regions of the image.
- */
-const int GRID_COLS = 4;
-
 /**
  * @brief Maximum number of messages that can be displayed in the application's interface.
  */
@@ -123,12 +151,6 @@ const int MAX_NUM_MESSAGES = 8;
  */
 const int MAX_LENGTH_MESSAGE = 32;
 
-/**
- * @brief Array of mutexes for the grid, used for region-based locking in image processing.
- */
-
-pthread_mutex_t gridMutexes[GRID_ROWS][GRID_COLS];
-
 
 /**
  * @brief Global variable to store the number of threads used in the application.
@@ -149,15 +171,13 @@ int numThreads;
  *
  * @param outputImage Pointer to the output image.
  * @param imageStack Vector of pointers to input images.
- * @param startRow Starting row of the region to be processed by the thread.
- * @param endRow Ending row of the region to be processed by the thread.
+ * @param worker Index of the thread, which it asks the focus engine for tiles with.
  */
 
 struct ThreadArgs {
     RasterImage* outputImage;
     std::vector<RasterImage*> imageStack;
-    int startRow;
-    int endRow;
+    unsigned int worker;
 };
 
 
@@ -260,10 +280,70 @@ void cleanupAndQuit(void) {
     }
     delete imageOut;
 
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
+
     // Exit the program
     exit(0);
 }
 
+/**
+ * @brief Waits for the focusing threads, then saves the output image, reports the
+ * timings and exits (headless mode).
+ *
+ * @param loadStart Time at which the input images started loading.
+ * @param focusStart Time at which the focusing threads were started.
+ */
+void finishHeadless(std::chrono::steady_clock::time_point loadStart, std::chrono::steady_clock::time_point focusStart)
+{
+    for (int i = 0; i < numThreads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    auto focusEnd = std::chrono::steady_clock::now();
+
+    writeTGA(outputPath.c_str(), imageOut);
+    auto saveEnd = std::chrono::steady_clock::now();
+
+    auto milliseconds = [](auto begin, auto end) {
+        return std::chrono::duration<double, std::milli>(end - begin).count();
+    };
+    printf("Focused %zu images of %ux%u with %d threads\n", images.size(), imageOut->width, imageOut->height,
+           numThreads);
+    printf("Load: %.3f ms, focus: %.3f ms, save: %.3f ms\n", milliseconds(loadStart, focusStart),
+           milliseconds(focusStart, focusEnd), milliseconds(focusEnd, saveEnd));
+
+    for (int k = 0; k < MAX_NUM_MESSAGES; k++) {
+        free(message[k]);
+    }
+    free(message);
+    for (auto img : images) {
+        delete img;
+    }
+    images.clear();
+    for (auto plane : grayPlanes) {
+        delete plane;
+    }
+    grayPlanes.clear();
+    for (auto contrastMap : contrastMaps) {
+        delete contrastMap;
+    }
+    contrastMaps.clear();
+    delete focusEngine;
+    delete windowBlender;
+    delete imageOut;
+    delete[] threads;
+
+    exit(0);
+}
+
 /**
  * @brief Handles keyboard events for the application.
  *
@@ -301,160 +381,50 @@ void handleKeyboardEvent(unsigned char c, int x, int y)
 
 
 /**
- * @brief Converts a pixel to grayscale.
+ * @brief Thread function to process tiles of the image.
  * 
- * @param image The image containing the pixel.
- * @param row The row of the pixel.
- * @param col The column of the pixel.
- * @return The grayscale value of the pixel.
- */
-double convertToGrayscale(RasterImage* image, int row, int col) {
-    if (image->type == RGBA32_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col) * 4;
-        // Using a weighted average for human perception: 0.21 R + 0.72 G + 0.07 B
-        return 0.21 * pixel[0] + 0.72 * pixel[1] + 0.07 * pixel[2];
-    }
-    else if (image->type == GRAY_RASTER) {
-        unsigned char* pixel = static_cast<unsigned char*>(image->raster) + (row * image->width + col);
-        return *pixel;
-    }
-    return 0;
-}
-
-/**
- * @brief Calculates the contrast of a window around a pixel.
- * 
- * @param image The image containing the pixel.
- * @param row The row of the central pixel of the window.
- * @param col The column of the central pixel of the window.
- * @return The contrast value.
- */
-double calculateWindowContrast(RasterImage* image, int row, int col, int windowSize){
-    double minGray = 255.0, maxGray = 0.0;
-
-    for (int i = -2; i <= 2; i++) {
-        for (int j = -2; j <= 2; j++) {
-            int neighborRow = row + i;
-            int neighborCol = col + j;
-            if (neighborRow >= 0 && neighborRow < image->height && neighborCol >= 0 && neighborCol < image->width) {
-                double gray = convertToGrayscale(image, neighborRow, neighborCol);
-                minGray = std::min(minGray, gray);
-                maxGray = std::max(maxGray, gray);
-            }
-        }
-    }
-
-    return maxGray - minGray; // Contrast is the range of grayscale values
-}
-
-/**
-/**
- * @brief Copies a pixel from one image to another.
- * 
- * @param srcImage Source image.
- * @param dstImage Destination image.
- * @param row Row of the pixel to copy.
- * @param col Column of the pixel to copy.
- */
-
-void copyPixel(RasterImage* srcImage, RasterImage* dstImage, int row, int col) {
-    unsigned char* srcPixel = static_cast<unsigned char*>(srcImage->raster) + (row * srcImage->width + col) * 4;
-    unsigned char* dstPixel = static_cast<unsigned char*>(dstImage->raster) + (row * dstImage->width + col) * 4;
-
-    memcpy(dstPixel, srcPixel, 4 * sizeof(unsigned char));  // Copy RGBA channels
-}
-
-/**
- * @brief Thread function to process a region of the image.
- * 
- * This function is executed by each thread. It processes a specific region of the input images
- * by focusing on the part with the highest contrast and writing it to the output image. The function 
- * receives a `ThreadArgs` struct containing all necessary data.
+ * This function is executed by each thread. It takes tiles from the focus engine until there
+ * are none left (or the program quits), and blends a window of the best image around every
+ * window center of each tile. Once every tile is blended, it writes the tiles it focused to
+ * the output image, with no lock: no other thread writes them.
  * 
  * @param arg A void pointer to a `ThreadArgs` struct which contains the output image, 
- *            vector of input images, and the start and end rows for processing.
+ *            vector of input images, and the index of the thread.
  * @return This function returns NULL. It is required by the pthreads API but is not used.
  */
 void* processRegion(void* arg) {
     numLiveFocusingThreads++;
-    int windowSize = 11; 
     ThreadArgs* args = static_cast<ThreadArgs*>(arg);
     RasterImage* outputImage = args->outputImage;
     std::vector<RasterImage*> imageStack = args->imageStack;
-    int startRow = args->startRow;
-    int endRow = args->endRow;
-    std::default_random_engine generator(std::random_device{}());
-    std::uniform_int_distribution<int> distributionRow(startRow, endRow - 1);
-    std::uniform_int_distribution<int> distributionCol(0, outputImage->width - 1);
-
-    while (continue_going) {
-        int centerRow = distributionRow(generator);
-        int centerCol = distributionCol(generator);
-        
-        // Determine regions to lock
-        std::set<std::pair<int, int>> uniqueRegions;
-        for (int i = -windowSize / 2; i <= windowSize / 2; ++i) {
-            for (int j = -windowSize / 2; j <= windowSize / 2; ++j) {
-                int targetRow = centerRow + i;
-                int targetCol = centerCol + j;
-                if (targetRow >= startRow && targetRow < endRow && targetCol >= 0 && targetCol < outputImage->width) {
-                    int regionRow = targetRow / (outputImage->height / GRID_ROWS);
-                    int regionCol = targetCol / (outputImage->width / GRID_COLS);
-                    uniqueRegions.insert({regionRow, regionCol});
-                }
-            }
-        }
-
-         // Create a vector of mutex pointers and sort them
-        pthread_mutex_lock(&imageMutex);
 
+    FocusTile tile;
+    std::vector<FocusTile> ownTiles;
+    std::vector<FocusWindow> windows;
+    while (continue_going && focusEngine->nextTile(args->worker, tile)) {
+        focusEngine->measureContrast(tile);
+        focusEngine->selectWindows(tile, BLEND_WINDOW_SIZE, windows);
 
-
-
-        double highestContrast = -1.0;
-        RasterImage* bestImage = nullptr;
-
-        // Calculate contrast and find best image
-        for (auto& img : imageStack) {
-            double contrast = calculateWindowContrast(img, centerRow, centerCol, windowSize);
-            if (contrast > highestContrast) {
-                highestContrast = contrast;
-                bestImage = img;
-            }
+        // Into the buffer of the tile, which no other thread writes
+        for (const FocusWindow& window : windows) {
+            windowBlender->add(tile, window, imageStack[window.bestImage]);
         }
+        windowBlender->tileDone();
+        ownTiles.push_back(tile);
+    }
 
-        // Lock for writing to the output image
-        if (bestImage) {
-            // Write or blend pixels from the best image to the output image
-            for (int i = -windowSize / 2; i <= windowSize / 2; ++i) {
-                for (int j = -windowSize / 2; j <= windowSize / 2; ++j) {
-                    unsigned int targetRow = centerRow + i;
-                    unsigned int targetCol = centerCol + j;
-                    if (targetRow >= 0 && targetRow < outputImage->height && targetCol >= 0 && targetCol < outputImage->width) {
-                        unsigned char* dstPixel = static_cast<unsigned char*>(outputImage->raster) + (targetRow * outputImage->width + targetCol) * 4;
-                        if (dstPixel[0] == 0 && dstPixel[1] == 0 && dstPixel[2] == 0) { // If pixel is black (0xFF000000)
-                            copyPixel(bestImage, outputImage, targetRow, targetCol);
-                        } else {
-                            // Blend the colors (simple average)
-                            unsigned char* srcPixel = static_cast<unsigned char*>(bestImage->raster) + (targetRow * bestImage->width + targetCol) * 4;
-                            for (int k = 0; k < 3; ++k) { // For R, G, B channels
-                                dstPixel[k] = static_cast<unsigned char>(0.5 * srcPixel[k] + 0.5 * dstPixel[k]);
-                            }
-                        }
-                    }
-                }
-            }
-
+    // Windows spill into the neighboring tiles, so the tiles are written once all are blended
+    if (windowBlender->waitForAllTiles(continue_going)) {
+        for (const FocusTile& ownTile : ownTiles) {
+            windowBlender->compose(ownTile, outputImage);
         }
-        pthread_mutex_unlock(&imageMutex);
-
     }
 
+    numLiveFocusingThreads--;
     delete args; // Clean up
     return NULL;
-    numLiveFocusingThreads--;
-
 }
+
 /**
  * @brief Initializes the application with input and output image paths.
  * 
@@ -479,6 +449,14 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
         }
     }
 
+    // Convert every image to gray once; the focusing threads compute the contrast maps, a tile at a time
+    for (auto img : images) {
+        RasterImage* plane = convertToGrayPlane(img);
+        RasterImage* contrastMap = new RasterImage(plane->width, plane->height, GRAY_RASTER);
+        grayPlanes.push_back(plane);
+        contrastMaps.push_back(contrastMap);
+    }
+
      if (!images.empty()) {
         imageOut = new RasterImage(images[0]->width, images[0]->height, RGBA32_RASTER);
     }
@@ -502,53 +480,77 @@ void initializeApplication(const vector<string>& inputPaths, const string& outPa
 
 
 int main(int argc, char** argv) {
+    // Options (--headless, --window <size>) come before the other arguments
+    int firstArg = 1;
+    while (firstArg < argc && strncmp(argv[firstArg], "--", 2) == 0) {
+        if (strcmp(argv[firstArg], "--headless") == 0) {
+            headless = true;
+            firstArg++;
+        } else if (strcmp(argv[firstArg], "--window") == 0 && firstArg + 1 < argc) {
+            contrastWindowSize = std::atoi(argv[firstArg + 1]);
+            firstArg += 2;
+        } else {
+            std::cerr << "Unknown option: " << argv[firstArg] << std::endl;
+            return 1;
+        }
+    }
+
     // Check if enough arguments are provided
-    if (argc < 4) {
-        std::cerr << "Usage: " << argv[0] << " <numThreads> <outputPath> <inputPaths...>" << std::endl;
+    if (argc - firstArg < 3) {
+        std::cerr << "Usage: " << argv[0] << " [--headless] [--window <size>] <numThreads> <outputPath> <inputPaths...>" << std::endl;
+        return 1;
+    }
+
+    // The contrast window is centered on its pixel
+    if (contrastWindowSize <= 0 || contrastWindowSize % 2 == 0) {
+        std::cerr << "Invalid contrast window size (must be odd): " << contrastWindowSize << std::endl;
         return 1;
     }
 
     // Parse the number of threads
-    numThreads = std::atoi(argv[1]);
+    numThreads = std::atoi(argv[firstArg]);
     if (numThreads <= 0) {
         std::cerr << "Invalid number of threads: " << numThreads << std::endl;
         return 1;
     }
 
     // Store the output path
-    outputPath = argv[2];
+    outputPath = argv[firstArg + 1];
 
     // Store the input image paths
     std::vector<std::string> inputPaths;
-    for (int i = 3; i < argc; ++i) {
+    for (int i = firstArg + 2; i < argc; ++i) {
         inputPaths.push_back(argv[i]);
     }
 
 
+    auto loadStart = std::chrono::steady_clock::now();
+
      // Initialize the application and load images
     initializeApplication(inputPaths, outputPath);
 
-    // Initialize the front-end (GUI)
-    initializeFrontEnd(argc, argv, imageOut);
-
-    pthread_mutex_init(&imageMutex, NULL);
-    for (int i = 0; i < GRID_ROWS; i++) {
-        for (int j = 0; j < GRID_COLS; j++) {
-            pthread_mutex_init(&gridMutexes[i][j], NULL);
-        }
+    // Initialize the front-end (GUI), unless running headless
+    if (!headless) {
+        initializeFrontEnd(argc, argv, imageOut);
     }
 
-    int rowsPerThread = imageOut->height / numThreads;
+    auto focusStart = std::chrono::steady_clock::now();
+
+    focusEngine = new FocusEngine(grayPlanes, contrastMaps, contrastWindowSize, numThreads);
+    windowBlender = new WindowBlender(*focusEngine, BLEND_WINDOW_SIZE);
+
 threads = new pthread_t[numThreads];
 for (int i = 0; i < numThreads; ++i) {
-    int startRow = i * rowsPerThread;
-    int endRow = (i == numThreads - 1) ? imageOut->height : startRow + rowsPerThread;
-    ThreadArgs* args = new ThreadArgs{imageOut, images, startRow, endRow};
+    ThreadArgs* args = new ThreadArgs{imageOut, images, static_cast<unsigned int>(i)};
     if (pthread_create(&threads[i], NULL, &processRegion, args) != 0) {
         cerr << "Failed to create thread." << endl;
     }
 }
 
+    if (headless) {
+        finishHeadless(loadStart, focusStart);
+    }
+
 
     // Start the GLUT main loop
     glutMainLoop();
@@ -1,8 +1,20 @@
 #!/bin/bash
 
+# Options are passed on to the program:
+#   --headless         no window, the output image is saved as soon as the focusing is done
+#   --window <size>    side of the window the contrast is measured over (odd, 5 by default)
+OPTIONS=()
+while [ "$#" -gt 0 ]; do
+    case "$1" in
+        --headless) OPTIONS+=("$1"); shift ;;
+        --window) OPTIONS+=("$1" "$2"); shift 2 ;;
+        *) break ;;
+    esac
+done
+
 # Check for correct number of arguments
 if [ "$#" -lt 4 ]; then
-    echo "Usage: $0 <path_to_executable> <num_threads> <path_to_output_image> <path_to_image_stack_folder>"
+    echo "Usage: $0 [--headless] [--window <size>] <path_to_executable> <num_threads> <path_to_output_image> <path_to_image_stack_folder>"
     exit 1
 fi
 
@@ -16,5 +28,5 @@ IMAGE_STACK_FOLDER=$4
 IMAGE_PATHS=($(ls $IMAGE_STACK_FOLDER/*.tga))
 
 # Run the stack focusing program
-$EXECUTABLE $NUM_THREADS $OUTPUT_PATH "${IMAGE_PATHS[@]}"
+$EXECUTABLE "${OPTIONS[@]}" $NUM_THREADS $OUTPUT_PATH "${IMAGE_PATHS[@]}"
 